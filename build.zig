@@ -56,6 +56,8 @@ pub fn build(b: *std.Build) !void {
         nwl_lib_mod.linkSystemLibrary("xkbcommon", .{});
         nwl_lib_mod.linkSystemLibrary("wayland-cursor", .{});
         nwl_lib_mod.addCSourceFile(.{ .file = b.path("src/seat.c"), .flags = &.{} });
+        nwl_lib_mod.addCSourceFile(.{ .file = b.path("src/keybind.c"), .flags = &.{} });
+        nwl_lib_mod.addCSourceFile(.{ .file = b.path("src/data.c"), .flags = &.{} });
         scannerstep.addSystemProtocols(&.{
             "staging/cursor-shape/cursor-shape-v1.xml",
             "unstable/tablet/tablet-unstable-v2.xml",
@@ -67,6 +69,7 @@ pub fn build(b: *std.Build) !void {
     }
     const conf = b.addConfigHeader(.{ .include_path = "nwl/config.h" }, .{
         .NWL_HAS_SEAT = @intFromBool(seat),
+        .NWL_HAS_IO_URING = 0,
     });
     nwl_lib_mod.addConfigHeader(conf);
     b.installArtifact(nwl_lib);
@@ -7,6 +7,9 @@ typedef struct _cairo cairo_t;
 typedef struct _cairo_surface cairo_surface_t;
 struct nwl_surface;
 struct wl_surface;
+struct nwl_easy;
+struct nwl_cairo_pipeline;
+struct nwl_cairo_renderer;
 
 struct nwl_cairo_surface {
 	cairo_t *ctx;
@@ -14,16 +17,47 @@ struct nwl_cairo_surface {
 	bool rerender;
 };
 
+struct nwl_cairo_rect {
+	int32_t x, y;
+	int32_t width, height;
+};
+
 struct nwl_cairo_renderer {
 	struct nwl_shm_bufferman shm;
 	struct nwl_cairo_surface cairo_surfaces[NWL_SHM_BUFFERMAN_MAX_BUFFERS];
 	int next_buffer;
 	int prev_buffer;
+	struct nwl_cairo_pipeline *pipeline; // Only when pipelined
 };
 
+// Runs on the render thread, so only touch the cairo surface and the snapshot in here!
+typedef void (*nwl_cairo_render_t)(struct nwl_cairo_surface *surface, void *snapshot);
+// Back on the dispatching thread, after the frame is committed or dropped. Free the snapshot here.
+typedef void (*nwl_cairo_render_done_t)(struct nwl_cairo_renderer *renderer, void *snapshot);
+
 void nwl_cairo_renderer_init(struct nwl_cairo_renderer *renderer);
 void nwl_cairo_renderer_finish(struct nwl_cairo_renderer *renderer);
 void nwl_cairo_renderer_submit(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface, int32_t x, int32_t y);
 struct nwl_cairo_surface *nwl_cairo_renderer_get_surface(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface, bool copyprevious);
+// Like get_surface with copyprevious, but what's inside region (in buffer pixels, NULL for all of it) is
+// moved by dx, dy. Only the strips in exposed are left to render, and the region is damaged.
+// If there was nothing to scroll, exposed is the whole buffer.
+struct nwl_cairo_surface *nwl_cairo_renderer_get_surface_scrolled(struct nwl_cairo_renderer *renderer,
+	struct nwl_surface *surface, int32_t dx, int32_t dy, const struct nwl_cairo_rect *region,
+	struct nwl_cairo_rect exposed[2], int *num_exposed);
+// Shows the same buffer on all the surfaces, rendered once. They should have the same size and scale,
+// and only the first one should drive updates. It gets the damage from get_surface, the rest are damaged fully.
+void nwl_cairo_renderer_submit_shared(struct nwl_cairo_renderer *renderer, struct nwl_surface **surfaces,
+	unsigned int num_surfaces, int32_t x, int32_t y);
+// Rasterize on a worker thread, while the dispatching thread keeps handling input.
+// Attaching and committing still happens on the dispatching thread, once the worker is done.
+// The frame in flight keeps a pointer to its surface, so call nwl_cairo_renderer_finish
+// before that surface is destroyed, its impl.destroy is a good place.
+bool nwl_cairo_renderer_set_pipelined(struct nwl_cairo_renderer *renderer, struct nwl_easy *easy,
+	nwl_cairo_render_t render, nwl_cairo_render_done_t done);
+// Use instead of drawing and submitting, after get_surface. The snapshot should hold everything render needs.
+// While a frame is in flight get_surface returns NULL, and the surface is updated again after it's out.
+bool nwl_cairo_renderer_submit_async(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface,
+	void *snapshot, int32_t x, int32_t y);
 
 #endif
@@ -5,6 +5,7 @@
 #include <wayland-util.h>
 
 struct wl_registry;
+struct wl_callback;
 
 struct nwl_output {
 	struct nwl_core *core;
@@ -19,6 +20,8 @@ struct nwl_output {
 	int32_t height;
 	char *name;
 	char *description;
+	// Called once is_done reaches 0, meaning all the output info is in.
+	void (*done)(struct nwl_output *output);
 };
 
 // Need a better name for these
@@ -55,6 +58,7 @@ struct nwl_core {
 		struct wl_subcompositor *subcompositor;
 		struct wl_data_device_manager *data_device_manager;
 		struct wp_cursor_shape_manager_v1 *cursor_shape_manager;
+		struct zwp_tablet_manager_v2 *tablet_manager;
 	} wl;
 	struct wl_list seats; // nwl_seat
 	struct wl_list outputs; // nwl_output
@@ -62,12 +66,28 @@ struct nwl_core {
 	struct wl_list surfaces_dirty; // nwl_surface dirtlink
 	struct wl_list subs; // nwl_core_sub
 
-	struct wl_cursor_theme *cursor_theme;
-	uint32_t cursor_theme_size;
 	uint32_t num_surfaces;
 	// When true, call nwl_core_handle_dirt
 	bool has_dirty_surfaces;
+	// Couldn't write everything to the compositor last flush. Consider skipping a frame or two!
+	// nwl_easy keeps it up to date and calls events.congestion when it changes.
+	bool display_congested;
 	const char *xdg_app_id; // This app_id is conveniently automagically set on xdg_toplevels, if not null
+	// Microseconds of surface updates per nwl_core_handle_dirt, 0 for no limit. Once it's spent,
+	// the remaining surfaces wait for the next round. Most urgent go first, see nwl_surface_priority.
+	uint32_t update_budget_us;
+	uint32_t updates_deferred; // In the last pass
+	uint64_t updates_deferred_total;
+	// Extra threads for updating NWL_SURFACE_FLAG_PARALLEL_UPDATE surfaces at the same time, 0 for none.
+	uint32_t update_threads;
+};
+
+// Max amount of Wayland events dispatched per nwl_easy_dispatch
+#define NWL_EASY_DEFAULT_DISPATCH_BUDGET 256
+
+enum nwl_poll_backend {
+	NWL_POLL_BACKEND_EPOLL = 0,
+	NWL_POLL_BACKEND_IO_URING // Needs nwl built with io_uring, falls back to epoll otherwise
 };
 
 struct nwl_poll {
@@ -75,6 +95,9 @@ struct nwl_poll {
 	int numfds;
 	struct epoll_event *ev;
 	struct wl_list data; // nwl_poll_data
+	enum nwl_poll_backend backend; // Set before nwl_easy_init
+	void *ring; // struct io_uring, when using that backend
+	uint64_t uring_next_id;
 };
 
 struct nwl_easy {
@@ -91,6 +114,10 @@ struct nwl_easy {
 			const char *interface, uint32_t version);
 		// The global disappears!
 		void (*global_remove)(struct nwl_easy *easy, struct wl_registry *registry, uint32_t name);
+		// Initial globals are bound, go create surfaces! Mostly useful with async_startup.
+		void (*ready)(struct nwl_easy *easy);
+		// core.display_congested changed. Good time to start or stop skipping frames.
+		void (*congestion)(struct nwl_easy *easy, bool congested);
 	} events;
 	struct wl_list globals; // nwl_easy_global
 
@@ -99,6 +126,13 @@ struct nwl_easy {
 	bool run_with_zero_surfaces;
 	bool has_errored;
 	bool has_new_outputs;
+	// Set before nwl_easy_init to not block on roundtrips. Globals are bound as they arrive,
+	// outputs are announced as they're done and events.ready is called once the core globals are in.
+	bool async_startup;
+	struct wl_callback *startup_cb;
+	bool display_reading; // Holding a read intent on the display
+	bool display_has_pending; // Ran out of budget, there may be events left in the queue
+	uint32_t dispatch_budget; // Set to 0 to use the default
 };
 
 struct nwl_easy_global {
@@ -112,11 +146,21 @@ struct nwl_easy_global {
 
 typedef void (*nwl_poll_callback_t)(struct nwl_easy *easy, uint32_t events, void* data);
 
+// Any other number works too, higher gets dispatched first
+enum nwl_poll_priority {
+	NWL_POLL_PRIORITY_LOW = -1,
+	NWL_POLL_PRIORITY_NORMAL = 0,
+	NWL_POLL_PRIORITY_INPUT = 1,
+};
+
 struct nwl_poll_data {
 	struct wl_list link;
 	int fd;
+	uint32_t events; // EPOLLET makes it a multishot poll with io_uring
+	int priority; // nwl_poll_priority
 	void *userdata;
 	nwl_poll_callback_t callback;
+	uint64_t uring_id; // user_data of its io_uring polls, never reused so stale completions can't match
 };
 
 void nwl_output_init(struct nwl_output *output, struct nwl_core *core, struct wl_output *wl_output);
@@ -125,9 +169,14 @@ void nwl_output_deinit(struct nwl_output *output);
 
 void nwl_core_init(struct nwl_core *core);
 void nwl_core_deinit(struct nwl_core *core);
+// Runs the updates of every dirty surface. Frame callbacks only mark surfaces dirty, they don't
+// update them, so when dispatching with plain wl_display_dispatch instead of nwl_easy,
+// call this after each dispatch while has_dirty_surfaces is set, or nothing gets redrawn.
 void nwl_core_handle_dirt(struct nwl_core *core);
 void nwl_core_add_sub(struct nwl_core *core, struct nwl_core_sub *sub);
 struct nwl_core_sub *nwl_core_get_sub(struct nwl_core *core, const struct nwl_core_sub_impl *subimpl);
+// Print time spent since nwl_easy_init to stderr, if NWL_STARTUP_TRACE is set. Stops after the first commit.
+void nwl_core_startup_trace(struct nwl_core *core, const char *phase);
 
 bool nwl_easy_init(struct nwl_easy *easy);
 void nwl_easy_deinit(struct nwl_easy *easy);
@@ -135,5 +184,7 @@ void nwl_easy_run(struct nwl_easy *easy);
 void nwl_easy_add_fd(struct nwl_easy *easy, int fd, uint32_t events,
 	nwl_poll_callback_t callback, void *data);
 void nwl_easy_del_fd(struct nwl_easy *easy, int fd);
+void nwl_easy_mod_fd(struct nwl_easy *easy, int fd, uint32_t events);
+void nwl_easy_set_fd_priority(struct nwl_easy *easy, int fd, int priority);
 bool nwl_easy_dispatch(struct nwl_easy *easy, int timeout);
 #endif
@@ -10,12 +10,76 @@ typedef uint32_t xkb_keysym_t;
 typedef uint32_t xkb_keycode_t;
 
 struct wl_data_source;
+struct zwp_tablet_seat_v2;
+struct zwp_tablet_tool_v2;
+
+// Atoms below this are tracked in a bitset on offers. Covers what apps usually ask for.
+#define NWL_MIME_SET_BITS 256
 
 struct nwl_data_offer {
-	struct wl_array mime;
+	struct wl_array mime_atoms; // uint32_t mime atoms, in the order they were offered
+	uint64_t mime_set[NWL_MIME_SET_BITS / 64];
 	struct wl_data_offer *offer;
 };
 
+enum nwl_data_receive_mode {
+	NWL_DATA_RECEIVE_CHUNKS, // data is called for every chunk as it comes in
+	NWL_DATA_RECEIVE_WHOLE, // data is called once with everything, right before done
+	NWL_DATA_RECEIVE_FD, // Spliced into dest_fd without copying, data isn't called
+};
+
+struct nwl_easy;
+struct nwl_data_receive {
+	struct nwl_easy *easy;
+	int fd; // Read end of the pipe
+	int dest_fd; // For NWL_DATA_RECEIVE_FD
+	bool owns_dest_fd; // A memfd made by nwl, closed after done unless dest_fd is set to -1 there
+	bool dest_blocked; // dest_fd is full, waiting for it to be writable instead of the pipe readable
+	bool in_callback; // Cancelling from data or done only marks it, it's freed once that returns
+	bool cancelled;
+	char mode; // nwl_data_receive_mode
+	size_t received;
+	struct wl_array buffer;
+	// Either may call nwl_data_receive_cancel, the receive stays valid until the callback returns.
+	void (*data)(struct nwl_data_receive *receive, const void *data, size_t size);
+	// Freed right after this.
+	void (*done)(struct nwl_data_receive *receive, bool success);
+	void *userdata;
+};
+
+enum nwl_data_payload_type {
+	NWL_DATA_PAYLOAD_BUFFER,
+	NWL_DATA_PAYLOAD_FD,
+	NWL_DATA_PAYLOAD_CALLBACK,
+};
+
+struct nwl_data_source;
+// Called for every send, put the data in out.
+typedef void (*nwl_data_source_callback_t)(struct nwl_data_source *source, const char *mime, struct wl_array *out);
+
+struct nwl_data_payload {
+	char *mime;
+	char type; // nwl_data_payload_type
+	void *data;
+	size_t size;
+	int fd;
+	bool sealed; // fd could be sealed, so sends may splice from it
+	nwl_data_source_callback_t callback;
+};
+
+// Serves every send from the nwl_easy loop without blocking, any number at once.
+struct nwl_data_source {
+	struct nwl_easy *easy;
+	struct wl_data_source *wl;
+	struct wl_array payloads; // nwl_data_payload
+	struct wl_list sends;
+	uint32_t action; // dnd action chosen by the compositor
+	// If not set, the source is destroyed when cancelled.
+	void (*cancelled)(struct nwl_data_source *source);
+	void (*dnd_finished)(struct nwl_data_source *source);
+	void *userdata;
+};
+
 enum nwl_dnd_event_type {
 	NWL_DND_EVENT_MOTION,
 	NWL_DND_EVENT_ENTER,
@@ -38,7 +102,7 @@ struct nwl_seat_keymap_xkb {
 	struct xkb_keymap *keymap;
 	struct xkb_state *state;
 	struct xkb_compose_state *compose_state;
-	struct xkb_compose_table *compose_table;
+	struct xkb_compose_table *compose_table; // Shared by all seats, see get_compose_table
 };
 
 
@@ -65,6 +129,10 @@ struct nwl_keyboard_event {
 	xkb_keycode_t keycode;
 	char utf8[16];
 	uint32_t serial;
+	// How many repeats a KEYREPEAT stands for, only more than 1 when coalescing
+	uint32_t repeat_count;
+	// Coalesced KEYREPEAT: utf8 repeated repeat_count times, only valid during the callback
+	const char *repeat_text;
 };
 
 
@@ -113,6 +181,124 @@ struct nwl_pointer_event {
 	bool focus;
 };
 
+// One wl_pointer.motion, as it came from the compositor
+struct nwl_pointer_sample {
+	uint32_t time; // Milliseconds, arbitrary base
+	wl_fixed_t surface_x;
+	wl_fixed_t surface_y;
+	struct nwl_surface *surface; // NULL if the surface was destroyed since
+	unsigned char buttons; // nwl_pointer_buttons
+};
+
+struct nwl_pointer_history {
+	struct nwl_pointer_sample *samples;
+	uint32_t capacity; // Power of two, 0 when disabled
+	uint32_t head; // Oldest sample
+	uint32_t count;
+	uint32_t overwritten; // Samples lost because nobody drained in time
+};
+
+#define NWL_TOUCH_MAX_POINTS 10
+
+enum nwl_touch_point_changed {
+	NWL_TOUCH_POINT_DOWN = 1 << 0,
+	NWL_TOUCH_POINT_UP = 1 << 1,
+	NWL_TOUCH_POINT_MOTION = 1 << 2,
+	NWL_TOUCH_POINT_SHAPE = 1 << 3,
+	NWL_TOUCH_POINT_ORIENTATION = 1 << 4,
+};
+
+struct nwl_touch_point {
+	int32_t id;
+	bool active; // False for free slots, and points that went up this frame
+	unsigned char changed; // nwl_touch_point_changed, since the last frame
+	struct nwl_surface *surface;
+	uint32_t serial;
+	uint32_t time;
+	wl_fixed_t surface_x;
+	wl_fixed_t surface_y;
+	wl_fixed_t major;
+	wl_fixed_t minor;
+	wl_fixed_t orientation; // Degrees
+};
+
+// Delivered once per wl_touch.frame to every surface with a changed point.
+// Points on other surfaces are in here too, so check point->surface.
+struct nwl_touch_event {
+	struct nwl_touch_point points[NWL_TOUCH_MAX_POINTS];
+	bool cancelled; // All points went up because the compositor took over
+};
+
+enum nwl_tablet_changed {
+	NWL_TABLET_PROXIMITY = 1 << 0,
+	NWL_TABLET_TIP = 1 << 1,
+	NWL_TABLET_MOTION = 1 << 2,
+	NWL_TABLET_PRESSURE = 1 << 3,
+	NWL_TABLET_DISTANCE = 1 << 4,
+	NWL_TABLET_TILT = 1 << 5,
+	NWL_TABLET_ROTATION = 1 << 6,
+	NWL_TABLET_SLIDER = 1 << 7,
+	NWL_TABLET_WHEEL = 1 << 8,
+	NWL_TABLET_BUTTON = 1 << 9,
+};
+
+enum nwl_tablet_buttons {
+	NWL_TABLET_BUTTON_STYLUS = 1 << 0,
+	NWL_TABLET_BUTTON_STYLUS2 = 1 << 1,
+	NWL_TABLET_BUTTON_STYLUS3 = 1 << 2,
+};
+
+// Tool state at the end of one zwp_tablet_tool_v2.frame
+struct nwl_tablet_sample {
+	uint32_t time;
+	uint16_t changed; // nwl_tablet_changed
+	bool proximity;
+	bool down;
+	unsigned char buttons; // nwl_tablet_buttons
+	wl_fixed_t surface_x;
+	wl_fixed_t surface_y;
+	uint16_t pressure; // 0 to 65535
+	uint16_t distance; // 0 to 65535
+	wl_fixed_t tilt_x; // Degrees
+	wl_fixed_t tilt_y;
+	wl_fixed_t rotation; // Degrees
+	int32_t slider; // -65535 to 65535
+	wl_fixed_t wheel; // Degrees, only for this sample
+	int32_t wheel_clicks;
+};
+
+struct nwl_tablet_tool {
+	struct wl_list link; // nwl_seat tablet.tools
+	struct nwl_seat *seat;
+	struct zwp_tablet_tool_v2 *wl;
+	uint32_t type; // zwp_tablet_tool_v2_type
+	uint32_t capabilities; // 1 << zwp_tablet_tool_v2_capability
+	uint64_t hardware_serial;
+	struct nwl_surface *focus;
+	uint32_t serial;
+	struct nwl_tablet_sample state; // The frame being put together
+	void *userdata;
+};
+
+// All samples of one tool on one surface since the last flush, oldest first
+struct nwl_tablet_event {
+	struct nwl_tablet_tool *tool;
+	const struct nwl_tablet_sample *samples;
+	uint32_t num_samples;
+	uint32_t serial;
+};
+
+enum nwl_keybind_mods {
+	NWL_KEYBIND_MOD_CTRL = 1 << 0,
+	NWL_KEYBIND_MOD_SHIFT = 1 << 1,
+	NWL_KEYBIND_MOD_ALT = 1 << 2,
+	NWL_KEYBIND_MOD_SUPER = 1 << 3,
+};
+
+struct nwl_seat;
+struct nwl_keybinds;
+typedef void (*nwl_keybind_callback_t)(struct nwl_seat *seat, struct nwl_surface *surface, void *data);
+
 struct nwl_seat {
 	struct nwl_core *core;
 	struct wl_list link;
@@ -128,14 +314,34 @@ struct nwl_seat {
 	struct nwl_seat_keymap_xkb keyboard_xkb;
 	bool keyboard_compose_enabled; // Recommended when typing! Maybe move this to surface?
 	bool keyboard_repeat_enabled;
+	bool keyboard_repeat_coalesce; // Repeats of text missed while busy come as a single event
 	struct nwl_surface *keyboard_focus;
 	int32_t keyboard_repeat_rate;
 	int32_t keyboard_repeat_delay;
 	int keyboard_repeat_fd;
+	// Compile uncached keymaps on a thread, holding back key events meanwhile. Only set this if
+	// keyboard_keymap_fd is polled and nwl_seat_handle_keymap called on it, nwl_easy does so.
+	bool keyboard_keymap_async;
+	int keyboard_keymap_fd; // Becomes readable when a keymap compiled in the background is ready
+	void *keyboard_keymap_job;
+	struct wl_array keyboard_repeat_text;
 	struct nwl_keyboard_event keyboard_event;
+	struct nwl_keybinds *keybinds; // Checked before input_keyboard, can be shared between seats
+	uint32_t keybind_mods; // nwl_keybind_mods
+	uint32_t keybind_state; // Where in a chord we are
+	struct wl_array keybind_keys; // uint32_t, held keys a keybind took, their release is swallowed too
+
+	struct {
+		struct zwp_tablet_seat_v2 *wl;
+		struct wl_list tools; // nwl_tablet_tool
+		struct wl_array tablets; // zwp_tablet_v2*
+		struct wl_array samples; // nwl_tablet_sample, waiting for nwl_seat_flush_tablet
+		struct nwl_tablet_tool *pending_tool;
+		struct nwl_surface *pending_focus;
+	} tablet;
 
 	struct wl_touch *touch;
-	struct nwl_surface *touch_focus;
+	struct nwl_touch_event touch_event;
 	uint32_t touch_serial;
 
 	struct wl_pointer *pointer;
@@ -145,8 +351,15 @@ struct nwl_seat {
 		struct wp_cursor_shape_device_v1 *shape_device;
 		struct wl_surface *xcursor_surface;
 		struct nwl_surface *nwl;
+		// Current xcursor, animated off xcursor_fd if it has more than one image
+		struct wl_cursor *xcursor;
+		int xcursor_fd; // timerfd, call nwl_seat_handle_xcursor when readable
+		int xcursor_image;
+		int32_t xcursor_scale;
+		char *xcursor_pending; // Set while the theme for the right scale loads
 	} pointer_surface;
 	struct nwl_pointer_event pointer_event;
+	struct nwl_pointer_history pointer_history;
 	char *name;
 	void *userdata;
 };
@@ -159,5 +372,44 @@ void nwl_seat_set_pointer_shape(struct nwl_seat *seat, enum wp_cursor_shape_devi
 bool nwl_seat_set_pointer_surface(struct nwl_seat *seat, struct nwl_surface *surface, int32_t hotspot_x, int32_t hotspot_y);
 bool nwl_seat_start_drag(struct nwl_seat *seat, struct wl_data_source *data_source, struct nwl_surface *icon);
 void nwl_seat_handle_repeat(struct nwl_seat *seat);
+// Hands the tablet samples gathered so far to input_tablet. nwl_easy does this after every dispatch.
+void nwl_seat_flush_tablet(struct nwl_seat *seat);
+// Keep every motion sample between frames, for drawing. Capacity is rounded up to a power of two, 0 turns it off.
+bool nwl_seat_set_pointer_history(struct nwl_seat *seat, uint32_t capacity);
+// Copies out up to max samples, oldest first, and removes them from the history.
+uint32_t nwl_seat_drain_pointer_history(struct nwl_seat *seat, struct nwl_pointer_sample *samples, uint32_t max);
+void nwl_seat_handle_keymap(struct nwl_seat *seat);
+void nwl_seat_handle_xcursor(struct nwl_seat *seat);
+// Receives an offer without blocking, the pipe is read from the nwl_easy loop. Offer is the seat's selection or drop.
+// Set the callbacks on the returned receive, nothing is read before the next dispatch.
+struct nwl_data_receive *nwl_seat_receive_offer(struct nwl_seat *seat, struct nwl_easy *easy,
+	struct nwl_data_offer *offer, const char *mime, enum nwl_data_receive_mode mode, int dest_fd);
+// Stops the transfer, done isn't called.
+void nwl_data_receive_cancel(struct nwl_data_receive *receive);
+// Interns mime, the same string always gets the same atom. Never 0.
+uint32_t nwl_mime_atom(struct nwl_core *core, const char *mime);
+// Like nwl_mime_atom, but returns 0 instead of adding unknown types.
+uint32_t nwl_mime_atom_lookup(struct nwl_core *core, const char *mime);
+const char *nwl_mime_atom_name(struct nwl_core *core, uint32_t atom);
+bool nwl_data_offer_has_mime(const struct nwl_data_offer *offer, uint32_t atom);
+struct nwl_data_source *nwl_data_source_create(struct nwl_easy *easy);
+void nwl_data_source_destroy(struct nwl_data_source *source);
+// The buffer is copied.
+bool nwl_data_source_offer_buffer(struct nwl_data_source *source, const char *mime, const void *data, size_t size);
+// Takes the fd, a memfd gets sealed and spliced from without copying.
+bool nwl_data_source_offer_fd(struct nwl_data_source *source, const char *mime, int fd);
+bool nwl_data_source_offer_callback(struct nwl_data_source *source, const char *mime, nwl_data_source_callback_t callback);
+void nwl_seat_set_selection(struct nwl_seat *seat, struct nwl_data_source *source, uint32_t serial);
+// Specs look like "Ctrl+Shift+K", or "Ctrl+X Ctrl+S" for chords.
+struct nwl_keybinds *nwl_keybinds_create(void);
+void nwl_keybinds_destroy(struct nwl_keybinds *binds);
+bool nwl_keybinds_add(struct nwl_keybinds *binds, const char *spec, nwl_keybind_callback_t callback, void *data);
+// Compiled keymaps are cached process wide, so they can be shared between seats and connections.
+// This drops them.
+void nwl_seat_keymap_cache_clear(void);
+// Load the cursor theme for this scale on a background thread, so it's ready once a cursor is set.
+// Themes are kept per scale until the core is destroyed. Setting a cursor never waits on a load,
+// it uses the nearest loaded scale until the right one is in, needing nwl_seat_handle_xcursor.
+void nwl_cursor_theme_prewarm(struct nwl_core *core, int32_t scale);
 
 #endif
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 
 struct wl_shm;
+struct wl_event_queue;
 struct nwl_core;
 
 struct nwl_shm_pool {
@@ -19,10 +20,17 @@ enum nwl_shm_buffer_flags {
 	NWL_SHM_BUFFER_DESTROY = 1 << 1
 };
 
+// Surfaces one buffer can be shown on at once
+#define NWL_SHM_BUFFER_MAX_VIEWS 8
+
 struct nwl_shm_buffer {
 	struct wl_buffer *wl_buffer;
 	uint8_t *bufferdata;
 	char flags; // nwl_shm_buffer_flags
+	// When attached to several surfaces, ACQUIRED is only cleared once all of them are released.
+	uint8_t acquired;
+	// More wl_buffers on the same memory, for surfaces after the first. Created on demand.
+	struct wl_buffer *views[NWL_SHM_BUFFER_MAX_VIEWS - 1];
 };
 
 #define NWL_SHM_BUFFERMAN_MAX_BUFFERS 4
@@ -36,6 +44,7 @@ struct nwl_shm_bufferman {
 	uint32_t stride;
 	uint32_t format;
 	uint8_t num_slots;
+	struct wl_event_queue *queue; // Queue for buffer release events, NULL for the default one
 };
 
 struct nwl_shm_bufferman_renderer_impl {
@@ -50,6 +59,8 @@ void nwl_shm_destroy(struct nwl_shm_pool *shm);
 
 // returns the buffer index, or -1 if there is no available buffer
 int nwl_shm_bufferman_get_next(struct nwl_shm_bufferman *bufferman);
+// The wl_buffer to attach to the view'th surface showing this buffer, 0 being the buffer's own.
+struct wl_buffer *nwl_shm_bufferman_get_view(struct nwl_shm_bufferman *bufferman, int buffer_idx, unsigned int view);
 
 // format is enum wl_shm_format
 void nwl_shm_bufferman_resize(struct nwl_shm_bufferman *bufferman, struct wl_shm *wl_shm,
@@ -6,9 +6,15 @@
 
 struct xdg_positioner;
 struct wl_output;
+struct wl_event_queue;
 enum nwl_surface_flags {
 	NWL_SURFACE_FLAG_NO_AUTOSCALE = 1 << 0,
 	NWL_SURFACE_FLAG_NO_AUTOCURSOR = 1 << 1, // ugh, this one shouldn't stay!
+	// Update may run on another thread, alongside other surfaces. It must only touch its own
+	// surface and renderer, like a panel or wallpaper with one layer surface per output.
+	// So does everything update calls into, renderer get_surface and submit included:
+	// those must not rely on being on the dispatch thread either.
+	NWL_SURFACE_FLAG_PARALLEL_UPDATE = 1 << 2,
 };
 
 // This is basically the xdg toplevel states + nwl nonsense..
@@ -39,6 +45,14 @@ enum nwl_surface_role {
 	NWL_SURFACE_ROLE_DRAGICON
 };
 
+// Decides the update order when nwl_core has an update budget.
+enum nwl_surface_priority {
+	NWL_SURFACE_PRIORITY_BACKGROUND = 0,
+	NWL_SURFACE_PRIORITY_VISIBLE,
+	NWL_SURFACE_PRIORITY_FOCUSED, // Surfaces with keyboard focus get this automatically
+	NWL_SURFACE_PRIORITY_POINTER // Under the pointer, never deferred. Not meant to be set.
+};
+
 enum nwl_xdg_wm_caps {
 	NWL_XDG_WM_CAP_WINDOW_MENU = 1 << 0,
 	NWL_XDG_WM_CAP_MAXIMIZE = 1 << 1,
@@ -51,10 +65,14 @@ struct nwl_seat;
 struct nwl_keyboard_event;
 struct nwl_pointer_event;
 struct nwl_dnd_event;
+struct nwl_tablet_event;
+struct nwl_touch_event;
 
 typedef void (*nwl_surface_configure_t)(struct nwl_surface *surface, uint32_t width, uint32_t height);
 typedef void (*nwl_surface_input_pointer_t)(struct nwl_surface *surface, struct nwl_seat *seat, struct nwl_pointer_event *event);
 typedef void (*nwl_surface_input_keyboard_t)(struct nwl_surface *surface, struct nwl_seat *seat, struct nwl_keyboard_event *event);
+typedef void (*nwl_surface_input_touch_t)(struct nwl_surface *surface, struct nwl_seat *seat, struct nwl_touch_event *event);
+typedef void (*nwl_surface_input_tablet_t)(struct nwl_surface *surface, struct nwl_seat *seat, struct nwl_tablet_event *event);
 typedef void (*nwl_surface_generic_func_t)(struct nwl_surface *surface);
 
 
@@ -62,6 +80,7 @@ struct nwl_surface {
 	struct wl_list link; // either linked to nwl_core, or another nwl_surface if subsurface
 	struct wl_list dirtlink; // link if dirty
 	struct nwl_core *core;
+	struct wl_event_queue *queue; // If set, surface events are dispatched here instead of the default queue
 	struct {
 		struct wl_surface *surface;
 		struct xdg_surface *xdg_surface;
@@ -83,6 +102,8 @@ struct nwl_surface {
 	char *title;
 	char role_id; // nwl_surface_role, if it has one.
 	bool defer_update; // for preventing recursive calls into the update function. Maybe have this as a state instead?
+	char priority; // nwl_surface_priority, VISIBLE by default
+	uint8_t deferrals; // Updates skipped in a row for lack of budget
 	// should be set by the update function!
 	union {
 		struct {
@@ -101,6 +122,7 @@ struct nwl_surface {
 			int32_t lx;
 			int32_t ly;
 			uint32_t reposition_token; // the latest received reposition token
+			struct nwl_surface *parent; // Destroyed along with it, NULL once it's gone
 		} popup;
 		struct {
 			struct zwlr_layer_surface_v1 *wl;
@@ -112,9 +134,14 @@ struct nwl_surface {
 		nwl_surface_generic_func_t destroy;
 		nwl_surface_input_pointer_t input_pointer;
 		nwl_surface_input_keyboard_t input_keyboard;
+		nwl_surface_input_touch_t input_touch;
+		nwl_surface_input_tablet_t input_tablet;
 		void (*dnd)(struct nwl_surface *surface, struct nwl_seat *seat, struct nwl_dnd_event *event);
 		nwl_surface_configure_t configure;
 		void (*close)(struct nwl_surface *surface);
+		// Surfaces with their own queue only: called when the surface needs nwl_surface_handle_dirt.
+		// May be called from any thread, wake up the thread owning the queue here.
+		nwl_surface_generic_func_t dirty;
 	} impl;
 };
 
@@ -128,6 +155,15 @@ void nwl_surface_request_callback(struct nwl_surface *surface);
 void nwl_surface_update(struct nwl_surface *surface);
 void nwl_surface_set_need_update(struct nwl_surface *surface, bool now);
 void nwl_surface_role_unset(struct nwl_surface *surface);
+// Move frame callbacks, buffer releases and configures of this surface to queue, so it can be
+// dispatched by another thread. Fails if the surface already has a role.
+// Input events are still delivered on the default queue!
+bool nwl_surface_set_queue(struct nwl_surface *surface, struct wl_event_queue *queue);
+// For surfaces with their own queue, nwl_core_handle_dirt won't touch them.
+// Call this from the thread owning the queue after dispatching it, or after impl.dirty, instead.
+// If the surface was marked for destruction this destroys it, which unlinks it from the core
+// unlocked. So the core must not be dispatched on another thread at the same time!
+void nwl_surface_handle_dirt(struct nwl_surface *surface);
 
 bool nwl_surface_role_subsurface(struct nwl_surface *surface, struct nwl_surface *parent);
 bool nwl_surface_role_layershell(struct nwl_surface *surface, struct wl_output *output, uint32_t layer);
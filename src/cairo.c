@@ -1,28 +1,76 @@
+#define _POSIX_C_SOURCE 200809L
 #include <cairo.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <wayland-client-protocol.h>
 #include "nwl/cairo.h"
 #include "nwl/shm.h"
 #include "nwl/nwl.h"
 #include "nwl/surface.h"
 
+static void attach_view(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface,
+		unsigned int view, int32_t x, int32_t y) {
+	if ((x != 0 || y != 0) && wl_surface_get_version(surface->wl.surface) >= 5) {
+		wl_surface_offset(surface->wl.surface, x, y);
+		x = 0;
+		y = 0;
+	}
+	wl_surface_attach(surface->wl.surface, nwl_shm_bufferman_get_view(&renderer->shm, renderer->next_buffer, view), x, y);
+}
+
 void nwl_cairo_renderer_submit(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface, int32_t x, int32_t y) {
 	if (renderer->next_buffer == -1) {
 		return;
 	}
 	renderer->prev_buffer = renderer->next_buffer;
 	renderer->cairo_surfaces[renderer->next_buffer].rerender = false;
-	if ((x != 0 || y != 0) && wl_surface_get_version(surface->wl.surface) >= 5) {
-		wl_surface_offset(surface->wl.surface, x, y);
-		x = 0;
-		y = 0;
-	}
 	renderer->shm.buffers[renderer->next_buffer].flags |= NWL_SHM_BUFFER_ACQUIRED;
-	wl_surface_attach(surface->wl.surface, renderer->shm.buffers[renderer->next_buffer].wl_buffer, x, y);
+	attach_view(renderer, surface, 0, x, y);
 	renderer->next_buffer = -1;
 	nwl_surface_buffer_submitted(surface);
 	wl_surface_commit(surface->wl.surface);
 }
 
+void nwl_cairo_renderer_submit_shared(struct nwl_cairo_renderer *renderer, struct nwl_surface **surfaces,
+		unsigned int num_surfaces, int32_t x, int32_t y) {
+	if (renderer->next_buffer == -1 || num_surfaces == 0) {
+		return;
+	}
+	if (num_surfaces > NWL_SHM_BUFFER_MAX_VIEWS) {
+		num_surfaces = NWL_SHM_BUFFER_MAX_VIEWS;
+	}
+	struct nwl_surface *primary = surfaces[0];
+	renderer->prev_buffer = renderer->next_buffer;
+	renderer->cairo_surfaces[renderer->next_buffer].rerender = false;
+	struct nwl_shm_buffer *buf = &renderer->shm.buffers[renderer->next_buffer];
+	buf->flags |= NWL_SHM_BUFFER_ACQUIRED;
+	buf->acquired = num_surfaces;
+	for (unsigned int i = 0; i < num_surfaces; i++) {
+		struct nwl_surface *surface = surfaces[i];
+		if (i > 0) {
+			if (surface->current_width != primary->current_width ||
+					surface->current_height != primary->current_height || surface->scale != primary->scale) {
+				surface->states &= ~NWL_SURFACE_STATE_NEEDS_APPLY_SIZE;
+				surface->scale = primary->scale;
+				surface->current_width = primary->current_width;
+				surface->current_height = primary->current_height;
+				wl_surface_set_buffer_scale(surface->wl.surface, primary->scale);
+			}
+			wl_surface_damage_buffer(surface->wl.surface, 0, 0, primary->current_width, primary->current_height);
+		}
+		attach_view(renderer, surface, i, x, y);
+		nwl_surface_buffer_submitted(surface);
+		wl_surface_commit(surface->wl.surface);
+	}
+	renderer->next_buffer = -1;
+}
+
 static int get_next_buffer(struct nwl_cairo_renderer *renderer, struct wl_shm *wl_shm) {
 	int buffer = nwl_shm_bufferman_get_next(&renderer->shm);
 	if (buffer == -1) {
@@ -34,7 +82,151 @@ static int get_next_buffer(struct nwl_cairo_renderer *renderer, struct wl_shm *w
 	return buffer;
 }
 
-struct nwl_cairo_surface *nwl_cairo_renderer_get_surface(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface, bool copyprevious) {
+// One frame in flight at most. The worker only ever touches the cairo surface it's handed,
+// everything Wayland stays on the dispatching thread.
+struct nwl_cairo_pipeline {
+	struct nwl_cairo_renderer *renderer;
+	struct nwl_easy *easy;
+	nwl_cairo_render_t render;
+	nwl_cairo_render_done_t done;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int done_fd;
+	// Handed over under the lock
+	struct nwl_cairo_surface *job;
+	void *job_snapshot;
+	bool quit;
+	// Dispatching thread only
+	bool busy;
+	struct nwl_surface *surface;
+	void *snapshot;
+	int32_t x, y;
+};
+
+static void *pipeline_thread(void *data) {
+	struct nwl_cairo_pipeline *pipeline = data;
+	pthread_mutex_lock(&pipeline->lock);
+	while (true) {
+		while (!pipeline->job && !pipeline->quit) {
+			pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+		}
+		if (pipeline->quit) {
+			break;
+		}
+		struct nwl_cairo_surface *csurf = pipeline->job;
+		void *snapshot = pipeline->job_snapshot;
+		pipeline->job = NULL;
+		pthread_mutex_unlock(&pipeline->lock);
+		pipeline->render(csurf, snapshot);
+		cairo_surface_flush(csurf->surface);
+		uint64_t one = 1;
+		// A lost wakeup would leave the pipeline busy forever.
+		while (write(pipeline->done_fd, &one, sizeof(uint64_t)) == -1) {
+			if (errno != EINTR) {
+				perror("nwl: cairo pipeline done_fd");
+				break;
+			}
+		}
+		pthread_mutex_lock(&pipeline->lock);
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+	return NULL;
+}
+
+static void handle_pipeline_done(struct nwl_easy *easy, uint32_t events, void *data) {
+	UNUSED(easy);
+	UNUSED(events);
+	struct nwl_cairo_pipeline *pipeline = data;
+	uint64_t count;
+	if (read(pipeline->done_fd, &count, sizeof(uint64_t)) == -1 || !pipeline->busy) {
+		return;
+	}
+	pipeline->busy = false;
+	// Surfaces going away don't want any more buffers.
+	if (!(pipeline->surface->states & NWL_SURFACE_STATE_DESTROY)) {
+		nwl_cairo_renderer_submit(pipeline->renderer, pipeline->surface, pipeline->x, pipeline->y);
+	}
+	if (pipeline->done) {
+		pipeline->done(pipeline->renderer, pipeline->snapshot);
+	}
+}
+
+static void pipeline_destroy(struct nwl_cairo_pipeline *pipeline) {
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->quit = true;
+	pthread_cond_signal(&pipeline->cond);
+	pthread_mutex_unlock(&pipeline->lock);
+	// Waits for a frame that's being rasterized, so the buffers can go right after.
+	pthread_join(pipeline->thread, NULL);
+	nwl_easy_del_fd(pipeline->easy, pipeline->done_fd);
+	close(pipeline->done_fd);
+	if (pipeline->busy && pipeline->done) {
+		pipeline->done(pipeline->renderer, pipeline->snapshot);
+	}
+	pthread_cond_destroy(&pipeline->cond);
+	pthread_mutex_destroy(&pipeline->lock);
+	free(pipeline);
+}
+
+bool nwl_cairo_renderer_set_pipelined(struct nwl_cairo_renderer *renderer, struct nwl_easy *easy,
+		nwl_cairo_render_t render, nwl_cairo_render_done_t done) {
+	if (renderer->pipeline) {
+		return false;
+	}
+	struct nwl_cairo_pipeline *pipeline = calloc(1, sizeof(struct nwl_cairo_pipeline));
+	pipeline->renderer = renderer;
+	pipeline->easy = easy;
+	pipeline->render = render;
+	pipeline->done = done;
+	pipeline->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (pipeline->done_fd == -1) {
+		free(pipeline);
+		return false;
+	}
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->cond, NULL);
+	if (pthread_create(&pipeline->thread, NULL, pipeline_thread, pipeline) != 0) {
+		pthread_cond_destroy(&pipeline->cond);
+		pthread_mutex_destroy(&pipeline->lock);
+		close(pipeline->done_fd);
+		free(pipeline);
+		return false;
+	}
+	nwl_easy_add_fd(easy, pipeline->done_fd, EPOLLIN, handle_pipeline_done, pipeline);
+	renderer->pipeline = pipeline;
+	return true;
+}
+
+bool nwl_cairo_renderer_submit_async(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface,
+		void *snapshot, int32_t x, int32_t y) {
+	struct nwl_cairo_pipeline *pipeline = renderer->pipeline;
+	if (!pipeline || pipeline->busy || renderer->next_buffer == -1) {
+		return false;
+	}
+	pipeline->busy = true;
+	pipeline->surface = surface;
+	pipeline->snapshot = snapshot;
+	pipeline->x = x;
+	pipeline->y = y;
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->job = &renderer->cairo_surfaces[renderer->next_buffer];
+	pipeline->job_snapshot = snapshot;
+	pthread_cond_signal(&pipeline->cond);
+	pthread_mutex_unlock(&pipeline->lock);
+	return true;
+}
+
+// Applies a new size and picks the buffer to render to, if that's not done yet.
+// picked is set when a new one was picked, which then needs its contents taken care of.
+static bool prepare_next_buffer(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface, bool *picked) {
+	*picked = false;
+	if (renderer->pipeline && renderer->pipeline->busy) {
+		// Still rasterizing the previous frame. Try again once it's out.
+		surface->states |= NWL_SURFACE_STATE_NEEDS_UPDATE;
+		return false;
+	}
+	renderer->shm.queue = surface->queue;
 	if (surface->states & NWL_SURFACE_STATE_NEEDS_APPLY_SIZE) {
 		surface->states = surface->states & ~NWL_SURFACE_STATE_NEEDS_APPLY_SIZE;
 		uint32_t scaled_width = surface->width * surface->scale;
@@ -49,30 +241,136 @@ struct nwl_cairo_surface *nwl_cairo_renderer_get_surface(struct nwl_cairo_render
 	}
 	if (renderer->next_buffer == -1) {
 		renderer->next_buffer = get_next_buffer(renderer, surface->core->wl.shm);
-		if (renderer->next_buffer != -1) {
-			// Only do this blit if rendering to a different buffer, to take advantage of
-			// compositors that immediately release buffers.
-			if (copyprevious) {
-				if (renderer->prev_buffer == -1) {
-					renderer->cairo_surfaces[renderer->next_buffer].rerender = true;
-				} else if (renderer->prev_buffer != renderer->next_buffer) {
-					struct nwl_cairo_surface *csurf = &renderer->cairo_surfaces[renderer->next_buffer];
-					struct nwl_cairo_surface *prevsurf = &renderer->cairo_surfaces[renderer->prev_buffer];
-					cairo_save(csurf->ctx);
-					cairo_reset_clip(csurf->ctx);
-					cairo_identity_matrix(csurf->ctx);
-					cairo_set_source_surface(csurf->ctx, prevsurf->surface, 0, 0);
-					cairo_set_operator(csurf->ctx, CAIRO_OPERATOR_SOURCE);
-					cairo_paint(csurf->ctx);
-					cairo_restore(csurf->ctx);
-				}
-			} else {
-				wl_surface_damage_buffer(surface->wl.surface, 0, 0, surface->current_width, surface->current_height);
+		*picked = renderer->next_buffer != -1;
+	}
+	return renderer->next_buffer != -1;
+}
+
+struct nwl_cairo_surface *nwl_cairo_renderer_get_surface(struct nwl_cairo_renderer *renderer, struct nwl_surface *surface, bool copyprevious) {
+	bool picked;
+	if (!prepare_next_buffer(renderer, surface, &picked)) {
+		return NULL;
+	}
+	if (picked) {
+		// Only do this blit if rendering to a different buffer, to take advantage of
+		// compositors that immediately release buffers.
+		if (copyprevious) {
+			if (renderer->prev_buffer == -1) {
 				renderer->cairo_surfaces[renderer->next_buffer].rerender = true;
+			} else if (renderer->prev_buffer != renderer->next_buffer) {
+				struct nwl_cairo_surface *csurf = &renderer->cairo_surfaces[renderer->next_buffer];
+				struct nwl_cairo_surface *prevsurf = &renderer->cairo_surfaces[renderer->prev_buffer];
+				cairo_save(csurf->ctx);
+				cairo_reset_clip(csurf->ctx);
+				cairo_identity_matrix(csurf->ctx);
+				cairo_set_source_surface(csurf->ctx, prevsurf->surface, 0, 0);
+				cairo_set_operator(csurf->ctx, CAIRO_OPERATOR_SOURCE);
+				cairo_paint(csurf->ctx);
+				cairo_restore(csurf->ctx);
 			}
+		} else {
+			wl_surface_damage_buffer(surface->wl.surface, 0, 0, surface->current_width, surface->current_height);
+			renderer->cairo_surfaces[renderer->next_buffer].rerender = true;
 		}
 	}
-	return renderer->next_buffer != -1 ? &renderer->cairo_surfaces[renderer->next_buffer] : NULL;
+	return &renderer->cairo_surfaces[renderer->next_buffer];
+}
+
+static void copy_span(uint8_t *dst, const uint8_t *src, size_t offset, size_t size) {
+	if (size) {
+		memcpy(dst + offset, src + offset, size);
+	}
+}
+
+struct nwl_cairo_surface *nwl_cairo_renderer_get_surface_scrolled(struct nwl_cairo_renderer *renderer,
+		struct nwl_surface *surface, int32_t dx, int32_t dy, const struct nwl_cairo_rect *region,
+		struct nwl_cairo_rect exposed[2], int *num_exposed) {
+	*num_exposed = 0;
+	bool picked;
+	if (!prepare_next_buffer(renderer, surface, &picked)) {
+		return NULL;
+	}
+	struct nwl_shm_bufferman *bm = &renderer->shm;
+	struct nwl_cairo_surface *csurf = &renderer->cairo_surfaces[renderer->next_buffer];
+	struct nwl_cairo_rect r = { 0, 0, bm->width, bm->height };
+	if (region) {
+		// Keep it inside the buffer
+		int32_t x2 = region->x + region->width, y2 = region->y + region->height;
+		r.x = region->x < 0 ? 0 : region->x;
+		r.y = region->y < 0 ? 0 : region->y;
+		r.width = (x2 > (int32_t)bm->width ? (int32_t)bm->width : x2) - r.x;
+		r.height = (y2 > (int32_t)bm->height ? (int32_t)bm->height : y2) - r.y;
+		if (r.width <= 0 || r.height <= 0) {
+			r.width = 0;
+			r.height = 0;
+		}
+	}
+	int src_idx = picked ? renderer->prev_buffer : renderer->next_buffer;
+	if (src_idx == -1) {
+		// Nothing to scroll, it all has to be drawn.
+		csurf->rerender = true;
+		exposed[0] = (struct nwl_cairo_rect) { 0, 0, bm->width, bm->height };
+		*num_exposed = 1;
+		wl_surface_damage_buffer(surface->wl.surface, 0, 0, bm->width, bm->height);
+		return csurf;
+	}
+	uint8_t *dst = bm->buffers[renderer->next_buffer].bufferdata;
+	uint8_t *src = bm->buffers[src_idx].bufferdata;
+	struct nwl_cairo_surface *srcsurf = &renderer->cairo_surfaces[src_idx];
+	cairo_surface_flush(srcsurf->surface);
+	cairo_surface_flush(csurf->surface);
+	const size_t bpp = 4; // ARGB32
+	if (src != dst) {
+		// Everything outside the region stays as it was.
+		for (uint32_t y = 0; y < bm->height; y++) {
+			uint8_t *drow = dst + y * bm->stride;
+			const uint8_t *srow = src + y * bm->stride;
+			if ((int32_t)y < r.y || (int32_t)y >= r.y + r.height) {
+				memcpy(drow, srow, bm->width * bpp);
+				continue;
+			}
+			copy_span(drow, srow, 0, r.x * bpp);
+			copy_span(drow, srow, (r.x + r.width) * bpp, (bm->width - r.x - r.width) * bpp);
+		}
+	}
+	int32_t adx = dx < 0 ? -dx : dx;
+	int32_t ady = dy < 0 ? -dy : dy;
+	if (adx >= r.width || ady >= r.height) {
+		// Scrolled all the way out of view
+		if (r.width > 0 && r.height > 0) {
+			exposed[0] = r;
+			*num_exposed = 1;
+		}
+	} else {
+		int32_t w = r.width - adx;
+		int32_t h = r.height - ady;
+		int32_t dst_x = r.x + (dx > 0 ? dx : 0);
+		int32_t src_x = r.x + (dx < 0 ? -dx : 0);
+		// Go against the direction of the scroll, so rows aren't overwritten before they're moved.
+		for (int32_t i = 0; i < h; i++) {
+			int32_t row = dy > 0 ? h - 1 - i : i;
+			int32_t dst_y = r.y + (dy > 0 ? dy : 0) + row;
+			int32_t src_y = r.y + (dy < 0 ? -dy : 0) + row;
+			memmove(dst + dst_y * bm->stride + dst_x * bpp, src + src_y * bm->stride + src_x * bpp, w * bpp);
+		}
+		if (ady) {
+			exposed[(*num_exposed)++] = (struct nwl_cairo_rect) {
+				r.x, dy > 0 ? r.y : r.y + h, r.width, ady
+			};
+		}
+		if (adx) {
+			exposed[(*num_exposed)++] = (struct nwl_cairo_rect) {
+				dx > 0 ? r.x : r.x + w, dy > 0 ? r.y + ady : r.y, adx, h
+			};
+		}
+	}
+	cairo_surface_mark_dirty(csurf->surface);
+	// The moved area and the exposed strips, together that's the region.
+	if ((dx || dy) && r.width > 0 && r.height > 0) {
+		wl_surface_damage_buffer(surface->wl.surface, r.x, r.y, r.width, r.height);
+	}
+	csurf->rerender = false;
+	return csurf;
 }
 
 static void cairo_create_shm_buffer(unsigned int buf_idx, struct nwl_shm_bufferman *bm) {
@@ -99,8 +397,13 @@ void nwl_cairo_renderer_init(struct nwl_cairo_renderer *renderer) {
 	renderer->shm.impl = &cairo_shmbuffer_impl;
 	renderer->prev_buffer = -1;
 	renderer->next_buffer = -1;
+	renderer->pipeline = NULL;
 }
 
 void nwl_cairo_renderer_finish(struct nwl_cairo_renderer *renderer) {
+	if (renderer->pipeline) {
+		pipeline_destroy(renderer->pipeline);
+		renderer->pipeline = NULL;
+	}
 	nwl_shm_bufferman_finish(&renderer->shm);
 }
@@ -0,0 +1,545 @@
+#define _GNU_SOURCE
+#include <wayland-client-protocol.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "nwl/nwl.h"
+#include "nwl/seat.h"
+
+// Every distinct mime type is strdup'd once and lives as long as the core.
+struct nwl_mime_atoms {
+	struct nwl_core_sub sub;
+	struct wl_array names; // char*, atom - 1 is the index
+	uint32_t *table; // Atoms, open addressed by name hash
+	uint32_t capacity; // Power of two
+};
+
+static void mime_atoms_sub_destroy(struct nwl_core_sub *sub) {
+	struct nwl_mime_atoms *atoms = wl_container_of(sub, atoms, sub);
+	char **name;
+	wl_array_for_each(name, &atoms->names) {
+		free(*name);
+	}
+	wl_array_release(&atoms->names);
+	free(atoms->table);
+	free(atoms);
+}
+
+static const struct nwl_core_sub_impl mime_atoms_sub_impl = {
+	mime_atoms_sub_destroy
+};
+
+static struct nwl_mime_atoms *get_mime_atoms(struct nwl_core *core) {
+	struct nwl_core_sub *exist = nwl_core_get_sub(core, &mime_atoms_sub_impl);
+	if (exist) {
+		struct nwl_mime_atoms *atoms = wl_container_of(exist, atoms, sub);
+		return atoms;
+	}
+	struct nwl_mime_atoms *atoms = calloc(1, sizeof(struct nwl_mime_atoms));
+	atoms->capacity = 64;
+	atoms->table = calloc(atoms->capacity, sizeof(uint32_t));
+	wl_array_init(&atoms->names);
+	atoms->sub.impl = &mime_atoms_sub_impl;
+	nwl_core_add_sub(core, &atoms->sub);
+	return atoms;
+}
+
+static uint32_t hash_mime(const char *mime) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (; *mime; mime++) {
+		h = (h ^ (unsigned char)*mime) * 16777619u;
+	}
+	return h;
+}
+
+static uint32_t *find_mime_slot(struct nwl_mime_atoms *atoms, uint32_t *table, uint32_t capacity,
+		const char *mime, uint32_t hash) {
+	char **names = atoms->names.data;
+	uint32_t i = hash & (capacity - 1);
+	while (table[i] && strcmp(names[table[i] - 1], mime) != 0) {
+		i = (i + 1) & (capacity - 1);
+	}
+	return &table[i];
+}
+
+static void mime_atoms_grow(struct nwl_mime_atoms *atoms) {
+	uint32_t capacity = atoms->capacity * 2;
+	uint32_t *table = calloc(capacity, sizeof(uint32_t));
+	char **names = atoms->names.data;
+	for (uint32_t i = 0; i < atoms->capacity; i++) {
+		uint32_t atom = atoms->table[i];
+		if (atom) {
+			*find_mime_slot(atoms, table, capacity, names[atom - 1], hash_mime(names[atom - 1])) = atom;
+		}
+	}
+	free(atoms->table);
+	atoms->table = table;
+	atoms->capacity = capacity;
+}
+
+uint32_t nwl_mime_atom_lookup(struct nwl_core *core, const char *mime) {
+	struct nwl_mime_atoms *atoms = get_mime_atoms(core);
+	return *find_mime_slot(atoms, atoms->table, atoms->capacity, mime, hash_mime(mime));
+}
+
+uint32_t nwl_mime_atom(struct nwl_core *core, const char *mime) {
+	struct nwl_mime_atoms *atoms = get_mime_atoms(core);
+	uint32_t hash = hash_mime(mime);
+	uint32_t *slot = find_mime_slot(atoms, atoms->table, atoms->capacity, mime, hash);
+	if (*slot) {
+		return *slot;
+	}
+	char **name = wl_array_add(&atoms->names, sizeof(char*));
+	*name = strdup(mime);
+	uint32_t count = atoms->names.size / sizeof(char*);
+	// Keep the load factor under a half
+	if (count * 2 > atoms->capacity) {
+		mime_atoms_grow(atoms);
+		slot = find_mime_slot(atoms, atoms->table, atoms->capacity, mime, hash);
+	}
+	*slot = count;
+	return count;
+}
+
+const char *nwl_mime_atom_name(struct nwl_core *core, uint32_t atom) {
+	struct nwl_mime_atoms *atoms = get_mime_atoms(core);
+	if (atom == 0 || atom > atoms->names.size / sizeof(char*)) {
+		return NULL;
+	}
+	return ((char**)atoms->names.data)[atom - 1];
+}
+
+bool nwl_data_offer_has_mime(const struct nwl_data_offer *offer, uint32_t atom) {
+	if (atom < NWL_MIME_SET_BITS) {
+		return offer->mime_set[atom / 64] & (1ull << (atom % 64));
+	}
+	uint32_t *offered;
+	wl_array_for_each(offered, &offer->mime_atoms) {
+		if (*offered == atom) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#define NWL_RECEIVE_CHUNK 65536
+// A big transfer shouldn't hog the loop, whatever is left is read next round.
+#define NWL_RECEIVE_CHUNKS_PER_WAKEUP 16
+
+static void finish_receive(struct nwl_data_receive *receive, bool success) {
+	if (receive->dest_blocked) {
+		nwl_easy_del_fd(receive->easy, receive->dest_fd);
+	} else {
+		nwl_easy_del_fd(receive->easy, receive->fd);
+	}
+	close(receive->fd);
+	// Cancelling from in here has nothing left to do but skip done, it's freed below anyway.
+	receive->in_callback = true;
+	if (success && receive->mode == NWL_DATA_RECEIVE_WHOLE && receive->data) {
+		receive->data(receive, receive->buffer.data, receive->buffer.size);
+	}
+	if (receive->done) {
+		receive->done(receive, success);
+	}
+	if (receive->owns_dest_fd && receive->dest_fd != -1) {
+		close(receive->dest_fd);
+	}
+	wl_array_release(&receive->buffer);
+	free(receive);
+}
+
+static ssize_t receive_chunk(struct nwl_data_receive *receive) {
+	if (receive->mode == NWL_DATA_RECEIVE_FD) {
+		// Straight from the pipe into the destination, never passing through here.
+		return splice(receive->fd, NULL, receive->dest_fd, NULL, NWL_RECEIVE_CHUNK,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	}
+	if (receive->mode == NWL_DATA_RECEIVE_CHUNKS) {
+		// The buffer is just scratch space then.
+		receive->buffer.size = 0;
+	}
+	char *dest = wl_array_add(&receive->buffer, NWL_RECEIVE_CHUNK);
+	if (!dest) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ssize_t n = read(receive->fd, dest, NWL_RECEIVE_CHUNK);
+	receive->buffer.size -= NWL_RECEIVE_CHUNK - (n > 0 ? n : 0);
+	if (n > 0 && receive->mode == NWL_DATA_RECEIVE_CHUNKS && receive->data) {
+		receive->in_callback = true;
+		receive->data(receive, dest, n);
+		receive->in_callback = false;
+	}
+	return n;
+}
+
+static void handle_receive(struct nwl_easy *easy, uint32_t events, void *data);
+
+static void handle_receive_dest(struct nwl_easy *easy, uint32_t events, void *data) {
+	struct nwl_data_receive *receive = data;
+	nwl_easy_del_fd(easy, receive->dest_fd);
+	nwl_easy_add_fd(easy, receive->fd, EPOLLIN, handle_receive, receive);
+	receive->dest_blocked = false;
+	handle_receive(easy, events, receive);
+}
+
+// Splice says EAGAIN both when the pipe is empty and when dest_fd is full. The pipe is level
+// triggered, so in the latter case it would keep waking up with nothing to be done.
+static bool receive_dest_full(struct nwl_data_receive *receive) {
+	struct pollfd pfd = { .fd = receive->dest_fd, .events = POLLOUT };
+	return receive->mode == NWL_DATA_RECEIVE_FD && poll(&pfd, 1, 0) == 0;
+}
+
+static void handle_receive(struct nwl_easy *easy, uint32_t events, void *data) {
+	UNUSED(events);
+	struct nwl_data_receive *receive = data;
+	for (int i = 0; i < NWL_RECEIVE_CHUNKS_PER_WAKEUP; i++) {
+		ssize_t n = receive_chunk(receive);
+		if (receive->cancelled) {
+			// Cancelled from the data callback, it couldn't be freed from under us there.
+			finish_receive(receive, false);
+			return;
+		}
+		if (n > 0) {
+			receive->received += n;
+			continue;
+		}
+		if (n == 0) {
+			finish_receive(receive, true);
+		} else if (errno == EAGAIN && receive_dest_full(receive)) {
+			// Stop listening to the pipe altogether, a hangup on it would spin just the same.
+			nwl_easy_del_fd(easy, receive->fd);
+			nwl_easy_add_fd(easy, receive->dest_fd, EPOLLOUT, handle_receive_dest, receive);
+			receive->dest_blocked = true;
+		} else if (errno != EAGAIN && errno != EINTR) {
+			finish_receive(receive, false);
+		}
+		return;
+	}
+}
+
+struct nwl_data_receive *nwl_seat_receive_offer(struct nwl_seat *seat, struct nwl_easy *easy,
+		struct nwl_data_offer *offer, const char *mime, enum nwl_data_receive_mode mode, int dest_fd) {
+	if (!offer->offer || (offer != &seat->data_device.selection && offer != &seat->data_device.drop)) {
+		return NULL;
+	}
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+		return NULL;
+	}
+	struct nwl_data_receive *receive = calloc(1, sizeof(struct nwl_data_receive));
+	receive->easy = easy;
+	receive->fd = fds[0];
+	receive->mode = mode;
+	receive->dest_fd = -1;
+	wl_array_init(&receive->buffer);
+	if (mode == NWL_DATA_RECEIVE_FD) {
+		receive->dest_fd = dest_fd;
+		if (dest_fd == -1) {
+			receive->dest_fd = memfd_create("nwl receive", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+			receive->owns_dest_fd = true;
+			if (receive->dest_fd == -1) {
+				close(fds[0]);
+				close(fds[1]);
+				free(receive);
+				return NULL;
+			}
+		}
+	}
+	wl_data_offer_receive(offer->offer, mime, fds[1]);
+	// The compositor has its own copy now, and the source sees EOF once it's done writing.
+	close(fds[1]);
+	nwl_easy_add_fd(easy, receive->fd, EPOLLIN, handle_receive, receive);
+	return receive;
+}
+
+void nwl_data_receive_cancel(struct nwl_data_receive *receive) {
+	receive->done = NULL;
+	receive->data = NULL;
+	if (receive->in_callback) {
+		receive->cancelled = true;
+		return;
+	}
+	finish_receive(receive, false);
+}
+
+#define NWL_SEND_CHUNK 65536
+#define NWL_SEND_CHUNKS_PER_WAKEUP 16
+
+struct data_send {
+	struct wl_list link; // nwl_data_source sends
+	struct nwl_data_source *source;
+	size_t payload; // Index, the payload array may move while sending
+	int fd;
+	loff_t offset;
+	struct wl_array buffer; // What a callback payload made for this send
+};
+
+static void finish_send(struct data_send *send) {
+	nwl_easy_del_fd(send->source->easy, send->fd);
+	close(send->fd);
+	wl_list_remove(&send->link);
+	wl_array_release(&send->buffer);
+	free(send);
+}
+
+static ssize_t send_chunk(struct data_send *send, struct nwl_data_payload *payload) {
+	const char *data;
+	size_t size;
+	if (payload->type == NWL_DATA_PAYLOAD_FD) {
+		size_t left = payload->size - send->offset;
+		// Page cache straight into the pipe. Not a pipe, or not sealed? Then copying it is.
+		if (payload->sealed) {
+			ssize_t n = splice(payload->fd, &send->offset, send->fd, NULL,
+				left < NWL_SEND_CHUNK ? left : NWL_SEND_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n != -1 || errno != EINVAL) {
+				return n;
+			}
+		}
+		char buf[4096];
+		ssize_t n = pread(payload->fd, buf, left < sizeof(buf) ? left : sizeof(buf), send->offset);
+		if (n <= 0) {
+			return n;
+		}
+		n = write(send->fd, buf, n);
+		if (n > 0) {
+			send->offset += n;
+		}
+		return n;
+	} else if (payload->type == NWL_DATA_PAYLOAD_CALLBACK) {
+		data = send->buffer.data;
+		size = send->buffer.size;
+	} else {
+		data = payload->data;
+		size = payload->size;
+	}
+	size_t left = size - send->offset;
+	ssize_t n = write(send->fd, data + send->offset, left < NWL_SEND_CHUNK ? left : NWL_SEND_CHUNK);
+	if (n > 0) {
+		send->offset += n;
+	}
+	return n;
+}
+
+static size_t send_size(struct data_send *send, struct nwl_data_payload *payload) {
+	return payload->type == NWL_DATA_PAYLOAD_CALLBACK ? send->buffer.size : payload->size;
+}
+
+static void handle_send(struct nwl_easy *easy, uint32_t events, void *data) {
+	UNUSED(easy);
+	struct data_send *send = data;
+	struct nwl_data_payload *payload = (struct nwl_data_payload*)send->source->payloads.data + send->payload;
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		// Reader went away.
+		finish_send(send);
+		return;
+	}
+	// A reader closing early shouldn't take the whole program down with it, but the
+	// SIGPIPE disposition belongs to the program. Block it on this thread while writing,
+	// and swallow the one the write raised, if any.
+	sigset_t pipe_set, old_set, pending;
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+	sigpending(&pending);
+	bool was_pending = sigismember(&pending, SIGPIPE);
+	bool broken = false;
+	for (int i = 0; i < NWL_SEND_CHUNKS_PER_WAKEUP; i++) {
+		if ((size_t)send->offset >= send_size(send, payload)) {
+			finish_send(send);
+			break;
+		}
+		ssize_t n = send_chunk(send, payload);
+		if (n > 0) {
+			continue;
+		}
+		if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+			broken = n == -1 && errno == EPIPE;
+			finish_send(send);
+		}
+		break;
+	}
+	if (broken && !was_pending) {
+		struct timespec zero = { 0 };
+		sigtimedwait(&pipe_set, NULL, &zero);
+	}
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+static struct nwl_data_payload *find_payload(struct nwl_data_source *source, const char *mime) {
+	struct nwl_data_payload *payload;
+	wl_array_for_each(payload, &source->payloads) {
+		if (strcmp(payload->mime, mime) == 0) {
+			return payload;
+		}
+	}
+	return NULL;
+}
+
+static void handle_source_target(void *data, struct wl_data_source *wl_data_source, const char *mime_type) {
+	UNUSED(data);
+	UNUSED(wl_data_source);
+	UNUSED(mime_type);
+}
+
+static void handle_source_send(void *data, struct wl_data_source *wl_data_source, const char *mime_type, int32_t fd) {
+	UNUSED(wl_data_source);
+	struct nwl_data_source *source = data;
+	struct nwl_data_payload *payload = find_payload(source, mime_type);
+	if (!payload) {
+		close(fd);
+		return;
+	}
+	struct data_send *send = calloc(1, sizeof(struct data_send));
+	send->source = source;
+	send->payload = payload - (struct nwl_data_payload*)source->payloads.data;
+	send->fd = fd;
+	wl_array_init(&send->buffer);
+	if (payload->type == NWL_DATA_PAYLOAD_CALLBACK) {
+		payload->callback(source, mime_type, &send->buffer);
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	wl_list_insert(&source->sends, &send->link);
+	nwl_easy_add_fd(source->easy, fd, EPOLLOUT, handle_send, send);
+}
+
+static void handle_source_cancelled(void *data, struct wl_data_source *wl_data_source) {
+	UNUSED(wl_data_source);
+	struct nwl_data_source *source = data;
+	if (source->cancelled) {
+		source->cancelled(source);
+	} else {
+		nwl_data_source_destroy(source);
+	}
+}
+
+static void handle_source_dnd_drop_performed(void *data, struct wl_data_source *wl_data_source) {
+	UNUSED(data);
+	UNUSED(wl_data_source);
+}
+
+static void handle_source_dnd_finished(void *data, struct wl_data_source *wl_data_source) {
+	UNUSED(wl_data_source);
+	struct nwl_data_source *source = data;
+	if (source->dnd_finished) {
+		source->dnd_finished(source);
+	}
+}
+
+static void handle_source_action(void *data, struct wl_data_source *wl_data_source, uint32_t dnd_action) {
+	UNUSED(wl_data_source);
+	struct nwl_data_source *source = data;
+	source->action = dnd_action;
+}
+
+static const struct wl_data_source_listener data_source_listener = {
+	handle_source_target,
+	handle_source_send,
+	handle_source_cancelled,
+	handle_source_dnd_drop_performed,
+	handle_source_dnd_finished,
+	handle_source_action
+};
+
+struct nwl_data_source *nwl_data_source_create(struct nwl_easy *easy) {
+	if (!easy->core.wl.data_device_manager) {
+		return NULL;
+	}
+	struct nwl_data_source *source = calloc(1, sizeof(struct nwl_data_source));
+	source->easy = easy;
+	source->wl = wl_data_device_manager_create_data_source(easy->core.wl.data_device_manager);
+	wl_array_init(&source->payloads);
+	wl_list_init(&source->sends);
+	wl_data_source_add_listener(source->wl, &data_source_listener, source);
+	return source;
+}
+
+void nwl_data_source_destroy(struct nwl_data_source *source) {
+	struct data_send *send, *tmp;
+	wl_list_for_each_safe(send, tmp, &source->sends, link) {
+		finish_send(send);
+	}
+	struct nwl_data_payload *payload;
+	wl_array_for_each(payload, &source->payloads) {
+		free(payload->mime);
+		if (payload->type == NWL_DATA_PAYLOAD_BUFFER) {
+			free(payload->data);
+		} else if (payload->type == NWL_DATA_PAYLOAD_FD) {
+			close(payload->fd);
+		}
+	}
+	wl_array_release(&source->payloads);
+	wl_data_source_destroy(source->wl);
+	free(source);
+}
+
+static struct nwl_data_payload *add_payload(struct nwl_data_source *source, const char *mime) {
+	// Offers can't be taken back, and sends may still refer to the old payload.
+	if (find_payload(source, mime)) {
+		return NULL;
+	}
+	struct nwl_data_payload *payload = wl_array_add(&source->payloads, sizeof(struct nwl_data_payload));
+	*payload = (struct nwl_data_payload) {
+		.mime = strdup(mime),
+		.fd = -1,
+	};
+	wl_data_source_offer(source->wl, mime);
+	return payload;
+}
+
+bool nwl_data_source_offer_buffer(struct nwl_data_source *source, const char *mime, const void *data, size_t size) {
+	struct nwl_data_payload *payload = add_payload(source, mime);
+	if (!payload) {
+		return false;
+	}
+	payload->type = NWL_DATA_PAYLOAD_BUFFER;
+	payload->data = malloc(size);
+	memcpy(payload->data, data, size);
+	payload->size = size;
+	return true;
+}
+
+bool nwl_data_source_offer_fd(struct nwl_data_source *source, const char *mime, int fd) {
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		return false;
+	}
+	struct nwl_data_payload *payload = add_payload(source, mime);
+	if (!payload) {
+		return false;
+	}
+	// Sends splice straight from the page cache, so the contents must not change under them.
+	// Files that can't be sealed are copied instead.
+	payload->sealed = fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == 0;
+	payload->type = NWL_DATA_PAYLOAD_FD;
+	payload->fd = fd;
+	payload->size = st.st_size;
+	return true;
+}
+
+bool nwl_data_source_offer_callback(struct nwl_data_source *source, const char *mime,
+		nwl_data_source_callback_t callback) {
+	struct nwl_data_payload *payload = add_payload(source, mime);
+	if (!payload) {
+		return false;
+	}
+	payload->type = NWL_DATA_PAYLOAD_CALLBACK;
+	payload->callback = callback;
+	return true;
+}
+
+void nwl_seat_set_selection(struct nwl_seat *seat, struct nwl_data_source *source, uint32_t serial) {
+	if (!seat->data_device.wl) {
+		return;
+	}
+	wl_data_device_set_selection(seat->data_device.wl, source ? source->wl : NULL, serial);
+}
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <xkbcommon/xkbcommon.h>
+#include "nwl/nwl.h"
+#include "nwl/seat.h"
+
+// A binding spec like "Ctrl+X Ctrl+S" is a chain of steps. Every step but the last
+// leads into a chord state, and each (state, mods, keysym) is one slot in an open addressed table.
+struct keybind_entry {
+	uint32_t state;
+	uint32_t mods; // nwl_keybind_mods
+	xkb_keysym_t keysym; // Lowercased, so Shift only counts through mods
+	uint32_t next_state; // Non zero for chord prefixes
+	nwl_keybind_callback_t callback;
+	void *data;
+};
+
+struct nwl_keybinds {
+	struct keybind_entry *entries;
+	uint32_t capacity; // Power of two
+	uint32_t count;
+	uint32_t states;
+};
+
+#define KEYBIND_MAX_STEPS 8
+
+static const struct {
+	const char *name;
+	uint32_t mod;
+} keybind_mod_names[] = {
+	{ "Ctrl", NWL_KEYBIND_MOD_CTRL },
+	{ "Control", NWL_KEYBIND_MOD_CTRL },
+	{ "Shift", NWL_KEYBIND_MOD_SHIFT },
+	{ "Alt", NWL_KEYBIND_MOD_ALT },
+	{ "Mod1", NWL_KEYBIND_MOD_ALT },
+	{ "Super", NWL_KEYBIND_MOD_SUPER },
+	{ "Logo", NWL_KEYBIND_MOD_SUPER },
+	{ "Mod4", NWL_KEYBIND_MOD_SUPER },
+};
+
+static uint32_t hash_keybind(uint32_t state, uint32_t mods, xkb_keysym_t keysym) {
+	uint32_t h = keysym * 0x9e3779b1u;
+	h ^= (mods | (state << 4)) * 0x85ebca6bu;
+	return h ^ (h >> 16);
+}
+
+static struct keybind_entry *find_slot(struct keybind_entry *entries, uint32_t capacity,
+		uint32_t state, uint32_t mods, xkb_keysym_t keysym) {
+	uint32_t i = hash_keybind(state, mods, keysym) & (capacity - 1);
+	while (entries[i].keysym != XKB_KEY_NoSymbol) {
+		struct keybind_entry *entry = &entries[i];
+		if (entry->state == state && entry->mods == mods && entry->keysym == keysym) {
+			break;
+		}
+		i = (i + 1) & (capacity - 1);
+	}
+	return &entries[i];
+}
+
+static void keybinds_grow(struct nwl_keybinds *binds) {
+	uint32_t capacity = binds->capacity * 2;
+	struct keybind_entry *entries = calloc(capacity, sizeof(struct keybind_entry));
+	for (uint32_t i = 0; i < binds->capacity; i++) {
+		struct keybind_entry *old = &binds->entries[i];
+		if (old->keysym != XKB_KEY_NoSymbol) {
+			*find_slot(entries, capacity, old->state, old->mods, old->keysym) = *old;
+		}
+	}
+	free(binds->entries);
+	binds->entries = entries;
+	binds->capacity = capacity;
+}
+
+struct nwl_keybinds *nwl_keybinds_create(void) {
+	struct nwl_keybinds *binds = calloc(1, sizeof(struct nwl_keybinds));
+	binds->capacity = 32;
+	binds->entries = calloc(binds->capacity, sizeof(struct keybind_entry));
+	return binds;
+}
+
+void nwl_keybinds_destroy(struct nwl_keybinds *binds) {
+	free(binds->entries);
+	free(binds);
+}
+
+static bool parse_step(const char *step, size_t len, uint32_t *mods, xkb_keysym_t *keysym) {
+	char buf[64];
+	*mods = 0;
+	while (len > 0) {
+		const char *plus = memchr(step, '+', len);
+		// A trailing "+" is the plus key itself, as in "Ctrl++"
+		size_t part = plus && plus != step ? (size_t)(plus - step) : len;
+		if (part >= sizeof(buf)) {
+			return false;
+		}
+		memcpy(buf, step, part);
+		buf[part] = '\0';
+		if (part == len) {
+			*keysym = xkb_keysym_from_name(buf, XKB_KEYSYM_CASE_INSENSITIVE);
+			if (*keysym == XKB_KEY_NoSymbol && part == 1) {
+				// Punctuation written as itself, "Ctrl+/"
+				*keysym = xkb_utf32_to_keysym((unsigned char)buf[0]);
+			}
+			*keysym = xkb_keysym_to_lower(*keysym);
+			return *keysym != XKB_KEY_NoSymbol;
+		}
+		size_t i;
+		for (i = 0; i < sizeof(keybind_mod_names) / sizeof(keybind_mod_names[0]); i++) {
+			if (strcasecmp(buf, keybind_mod_names[i].name) == 0) {
+				*mods |= keybind_mod_names[i].mod;
+				break;
+			}
+		}
+		if (i == sizeof(keybind_mod_names) / sizeof(keybind_mod_names[0])) {
+			return false;
+		}
+		step += part + 1;
+		len -= part + 1;
+	}
+	return false;
+}
+
+bool nwl_keybinds_add(struct nwl_keybinds *binds, const char *spec,
+		nwl_keybind_callback_t callback, void *data) {
+	uint32_t mods[KEYBIND_MAX_STEPS];
+	xkb_keysym_t keysyms[KEYBIND_MAX_STEPS];
+	int steps = 0;
+	const char *cur = spec;
+	// Parse everything first so a bad spec doesn't leave half a chord behind.
+	while (*cur) {
+		if (*cur == ' ') {
+			cur++;
+			continue;
+		}
+		size_t len = strcspn(cur, " ");
+		if (steps == KEYBIND_MAX_STEPS || !parse_step(cur, len, &mods[steps], &keysyms[steps])) {
+			return false;
+		}
+		steps++;
+		cur += len;
+	}
+	if (steps == 0) {
+		return false;
+	}
+	// Check the whole path before changing anything.
+	uint32_t state = 0;
+	for (int i = 0; i < steps; i++) {
+		struct keybind_entry *entry = find_slot(binds->entries, binds->capacity, state, mods[i], keysyms[i]);
+		if (entry->keysym == XKB_KEY_NoSymbol) {
+			break;
+		}
+		bool last = i == steps - 1;
+		if (last != (entry->next_state == 0)) {
+			// A binding can't be both a chord prefix and a complete binding.
+			return false;
+		}
+		state = entry->next_state;
+	}
+	state = 0;
+	for (int i = 0; i < steps; i++) {
+		// Keep the load factor under a half
+		if ((binds->count + 1) * 2 > binds->capacity) {
+			keybinds_grow(binds);
+		}
+		struct keybind_entry *entry = find_slot(binds->entries, binds->capacity, state, mods[i], keysyms[i]);
+		if (entry->keysym == XKB_KEY_NoSymbol) {
+			binds->count++;
+			*entry = (struct keybind_entry) {
+				.state = state,
+				.mods = mods[i],
+				.keysym = keysyms[i],
+			};
+			if (i < steps - 1) {
+				entry->next_state = ++binds->states;
+			}
+		}
+		if (i == steps - 1) {
+			entry->callback = callback;
+			entry->data = data;
+		}
+		state = entry->next_state;
+	}
+	return true;
+}
+
+static bool keysym_is_modifier(xkb_keysym_t keysym) {
+	return (keysym >= XKB_KEY_Shift_L && keysym <= XKB_KEY_Hyper_R) ||
+		(keysym >= XKB_KEY_ISO_Lock && keysym <= XKB_KEY_ISO_Level5_Lock);
+}
+
+// Returns true if the key belongs to the bindings. Callback is NULL when it only moved along a chord.
+// base is the keysym without Shift applied, so "Shift+1" matches even though the key gives "exclam".
+bool nwl_keybinds_lookup(struct nwl_keybinds *binds, uint32_t *state, uint32_t mods, xkb_keysym_t keysym,
+		xkb_keysym_t base, nwl_keybind_callback_t *callback, void **data) {
+	*callback = NULL;
+	if (keysym_is_modifier(keysym)) {
+		// Have to be able to press Ctrl in the middle of a chord.
+		return false;
+	}
+	keysym = xkb_keysym_to_lower(keysym);
+	struct keybind_entry *entry = find_slot(binds->entries, binds->capacity, *state, mods, keysym);
+	if (entry->keysym == XKB_KEY_NoSymbol && base != XKB_KEY_NoSymbol && (mods & NWL_KEYBIND_MOD_SHIFT)) {
+		entry = find_slot(binds->entries, binds->capacity, *state, mods, xkb_keysym_to_lower(base));
+	}
+	if (entry->keysym == XKB_KEY_NoSymbol) {
+		bool in_chord = *state != 0;
+		// A key that doesn't continue the chord cancels it, and is swallowed too.
+		*state = 0;
+		return in_chord;
+	}
+	*state = entry->next_state;
+	*callback = entry->callback;
+	*data = entry->data;
+	return true;
+}
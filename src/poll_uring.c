@@ -0,0 +1,137 @@
+#include <errno.h>
+#include <liburing.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include "nwl/nwl.h"
+
+#define NWL_URING_ENTRIES 64
+// Only the bits that mean the same thing to poll(2)
+#define NWL_URING_POLL_MASK (EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLRDHUP)
+
+bool nwl_uring_init(struct nwl_poll *poll) {
+	struct io_uring *ring = calloc(1, sizeof(struct io_uring));
+	if (io_uring_queue_init(NWL_URING_ENTRIES, ring, 0) < 0) {
+		free(ring);
+		return false;
+	}
+	poll->ring = ring;
+	return true;
+}
+
+void nwl_uring_destroy(struct nwl_poll *poll) {
+	io_uring_queue_exit(poll->ring);
+	free(poll->ring);
+	poll->ring = NULL;
+}
+
+static struct io_uring_sqe *get_sqe(struct io_uring *ring) {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		// Submission queue is full, push it all out and try again.
+		io_uring_submit(ring);
+		sqe = io_uring_get_sqe(ring);
+	}
+	return sqe;
+}
+
+static void arm_poll(struct io_uring *ring, struct nwl_poll_data *data) {
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	// Edge triggered fds get a multishot poll, the rest are rearmed after every completion
+	// which keeps them level triggered like epoll.
+	if (data->events & EPOLLET) {
+		io_uring_prep_poll_multishot(sqe, data->fd, data->events & NWL_URING_POLL_MASK);
+	} else {
+		io_uring_prep_poll_add(sqe, data->fd, data->events & NWL_URING_POLL_MASK);
+	}
+	io_uring_sqe_set_data64(sqe, data->uring_id);
+}
+
+// Completions of removed polls may still be sitting in the queue. Going by the address, a new
+// nwl_poll_data allocated in the same spot would get them, so it's by id.
+static struct nwl_poll_data *find_data(struct nwl_poll *poll, uint64_t id) {
+	struct nwl_poll_data *data;
+	wl_list_for_each(data, &poll->data, link) {
+		if (data->uring_id == id) {
+			return data;
+		}
+	}
+	return NULL;
+}
+
+void nwl_uring_add(struct nwl_poll *poll, struct nwl_poll_data *data) {
+	data->uring_id = ++poll->uring_next_id;
+	arm_poll(poll->ring, data);
+}
+
+void nwl_uring_mod(struct nwl_poll *poll, struct nwl_poll_data *data) {
+	struct io_uring_sqe *sqe = get_sqe(poll->ring);
+	unsigned flags = IORING_POLL_UPDATE_EVENTS;
+	if (data->events & EPOLLET) {
+		flags |= IORING_POLL_ADD_MULTI;
+	}
+	// If the poll already completed this fails, and the rearm picks up the new events instead.
+	io_uring_prep_poll_update(sqe, data->uring_id, 0, data->events & NWL_URING_POLL_MASK, flags);
+	io_uring_sqe_set_data64(sqe, 0);
+}
+
+void nwl_uring_del(struct nwl_poll *poll, struct nwl_poll_data *data) {
+	struct io_uring_sqe *sqe = get_sqe(poll->ring);
+	io_uring_prep_poll_remove(sqe, data->uring_id);
+	io_uring_sqe_set_data64(sqe, 0);
+	// The poll holds a reference to the file, so get rid of it before the fd is closed.
+	io_uring_submit(poll->ring);
+}
+
+int nwl_uring_wait(struct nwl_poll *poll, int timeout) {
+	struct io_uring *ring = poll->ring;
+	struct io_uring_cqe *cqe;
+	struct __kernel_timespec ts = {
+		.tv_sec = timeout / 1000,
+		.tv_nsec = (timeout % 1000) * 1000000
+	};
+	// Rearms from the last round go out with the wait, in the same syscall.
+	int ret = io_uring_submit_and_wait_timeout(ring, &cqe, 1, timeout < 0 ? NULL : &ts, NULL);
+	if (ret < 0 && ret != -ETIME) {
+		errno = -ret;
+		return -1;
+	}
+	int nfds = 0;
+	unsigned head;
+	unsigned seen = 0;
+	io_uring_for_each_cqe(ring, head, cqe) {
+		if (nfds == poll->numfds) {
+			break;
+		}
+		seen++;
+		uint64_t id = io_uring_cqe_get_data64(cqe);
+		struct nwl_poll_data *data = id ? find_data(poll, id) : NULL;
+		if (!data) {
+			continue;
+		}
+		uint32_t events = cqe->res;
+		if (cqe->res == -ECANCELED) {
+			// Knocked out by an update or the kernel, the fd is still wanted.
+			arm_poll(ring, data);
+			continue;
+		} else if (cqe->res < 0) {
+			// Not rearmed, it would just fail again. Like epoll, let the callback deal with it.
+			events = EPOLLERR;
+		} else if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			arm_poll(ring, data);
+		}
+		int i;
+		for (i = 0; i < nfds; i++) {
+			if (poll->ev[i].data.ptr == data) {
+				poll->ev[i].events |= events;
+				break;
+			}
+		}
+		if (i == nfds) {
+			poll->ev[nfds].data.ptr = data;
+			poll->ev[nfds].events = events;
+			nfds++;
+		}
+	}
+	io_uring_cq_advance(ring, seen);
+	return nfds;
+}
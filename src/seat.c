@@ -2,9 +2,14 @@
 #include <wayland-client-protocol.h>
 #include <wayland-cursor.h>
 #include <linux/input-event-codes.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <xkbcommon/xkbcommon.h>
 #include <xkbcommon/xkbcommon-compose.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/timerfd.h>
 #include <string.h>
@@ -13,6 +18,11 @@
 #include "nwl/surface.h"
 #include "nwl/seat.h"
 #include "cursor-shape-v1.h"
+#include "tablet-unstable-v2.h"
+
+// in keybind.c
+bool nwl_keybinds_lookup(struct nwl_keybinds *binds, uint32_t *state, uint32_t mods, xkb_keysym_t keysym,
+	xkb_keysym_t base, nwl_keybind_callback_t *callback, void **data);
 
 static const char *get_env_locale() {
 	const char *loc;
@@ -28,10 +38,30 @@ static const char *get_env_locale() {
 struct nwl_xkb_context {
 	struct nwl_core_sub sub;
 	struct xkb_context *ctx;
+	// The compose table only depends on the locale, so every seat and keymap shares this one.
+	// Seats take their own reference.
+	struct xkb_compose_table *compose_table;
+	bool compose_tried;
+	// Loading in the background since the first keyboard showed up, see compose_table_prewarm.
+	bool compose_loading;
+	pthread_t compose_thread;
+	struct xkb_compose_table *compose_loaded;
 };
 
+static struct xkb_compose_table *compose_table_join(struct nwl_xkb_context *xkbsub) {
+	pthread_join(xkbsub->compose_thread, NULL);
+	xkbsub->compose_loading = false;
+	return xkbsub->compose_loaded;
+}
+
 static void xkb_context_sub_destroy(struct nwl_core_sub *sub) {
 	struct nwl_xkb_context *xkbsub = wl_container_of(sub, xkbsub, sub);
+	if (xkbsub->compose_loading && compose_table_join(xkbsub)) {
+		xkb_compose_table_unref(xkbsub->compose_loaded);
+	}
+	if (xkbsub->compose_table) {
+		xkb_compose_table_unref(xkbsub->compose_table);
+	}
 	xkb_context_unref(xkbsub->ctx);
 	free(xkbsub);
 }
@@ -40,23 +70,91 @@ static const struct nwl_core_sub_impl xkb_context_sub_impl = {
 	xkb_context_sub_destroy
 };
 
-static struct xkb_context *get_xkb_context(struct nwl_core *core) {
+static struct nwl_xkb_context *get_xkb_sub(struct nwl_core *core) {
 	struct nwl_core_sub *exist = nwl_core_get_sub(core, &xkb_context_sub_impl);
 	if (exist) {
 		struct nwl_xkb_context *xkbsub = wl_container_of(exist, xkbsub, sub);
-		return xkbsub->ctx;
+		return xkbsub;
 	}
-	struct nwl_xkb_context *xkbsub = malloc(sizeof(struct nwl_xkb_context));
+	struct nwl_xkb_context *xkbsub = calloc(1, sizeof(struct nwl_xkb_context));
 	xkbsub->ctx = xkb_context_new(0);
 	xkbsub->sub.impl = &xkb_context_sub_impl;
 	nwl_core_add_sub(core, &xkbsub->sub);
-	return xkbsub->ctx;
+	nwl_core_startup_trace(core, "xkb context");
+	return xkbsub;
+}
+
+static struct xkb_context *get_xkb_context(struct nwl_core *core) {
+	return get_xkb_sub(core)->ctx;
+}
+
+// Hands over a table the keymap job loaded, unless one is already there.
+static void set_compose_table(struct nwl_core *core, struct xkb_compose_table *table) {
+	struct nwl_xkb_context *xkbsub = get_xkb_sub(core);
+	if (xkbsub->compose_tried) {
+		if (table) {
+			xkb_compose_table_unref(table);
+		}
+		return;
+	}
+	xkbsub->compose_tried = true;
+	xkbsub->compose_table = table;
+	nwl_core_startup_trace(core, "compose table loaded");
+}
+
+static void *compose_table_thread(void *data) {
+	struct nwl_xkb_context *xkbsub = data;
+	// xkb contexts aren't thread safe, so the thread gets its own.
+	struct xkb_context *context = xkb_context_new(0);
+	xkbsub->compose_loaded = xkb_compose_table_new_from_locale(context, get_env_locale(), 0);
+	xkb_context_unref(context);
+	return NULL;
+}
+
+// Parsing the compose file takes a while, start on it before the first key press needs it.
+static void compose_table_prewarm(struct nwl_core *core) {
+	struct nwl_xkb_context *xkbsub = get_xkb_sub(core);
+	if (xkbsub->compose_tried || xkbsub->compose_loading) {
+		return;
+	}
+	xkbsub->compose_loading = pthread_create(&xkbsub->compose_thread, NULL, compose_table_thread, xkbsub) == 0;
+}
+
+// Waits for the table if it's still loading, or loads it right here if it was never prewarmed.
+static struct xkb_compose_table *get_compose_table(struct nwl_core *core) {
+	struct nwl_xkb_context *xkbsub = get_xkb_sub(core);
+	if (!xkbsub->compose_tried) {
+		set_compose_table(core, xkbsub->compose_loading ? compose_table_join(xkbsub) :
+			xkb_compose_table_new_from_locale(xkbsub->ctx, get_env_locale(), 0));
+	}
+	return xkbsub->compose_table;
 }
 
+// Compositors send the exact same keymap text to every seat, on every layout switch and to every client.
+// Compiling it takes a while, so keep the last few around, keyed by a hash of the text.
+// xkb refcounts aren't atomic, so any ref or unref of a cached keymap, xkb_state included, holds the lock.
+#define NWL_KEYMAP_CACHE_SIZE 8
+
+struct keymap_cache_entry {
+	uint64_t hash;
+	size_t size;
+	char *text;
+	struct xkb_keymap *keymap;
+	uint32_t last_used;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct keymap_cache_entry entries[NWL_KEYMAP_CACHE_SIZE];
+	uint32_t clock;
+} keymap_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
 static void unref_seat_xkb(struct nwl_seat *seat) {
 	if (seat->keyboard_xkb.keymap) {
+		pthread_mutex_lock(&keymap_cache.lock);
 		xkb_state_unref(seat->keyboard_xkb.state);
 		xkb_keymap_unref(seat->keyboard_xkb.keymap);
+		pthread_mutex_unlock(&keymap_cache.lock);
 	}
 	if (seat->keyboard_xkb.compose_state) {
 		xkb_compose_state_unref(seat->keyboard_xkb.compose_state);
@@ -67,10 +165,242 @@ static void unref_seat_xkb(struct nwl_seat *seat) {
 	seat->keyboard_xkb = (struct nwl_seat_keymap_xkb){0};
 }
 
+static uint64_t hash_keymap(const char *text, size_t size) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static struct xkb_keymap *keymap_cache_lookup(uint64_t hash, const char *text, size_t size) {
+	for (int i = 0; i < NWL_KEYMAP_CACHE_SIZE; i++) {
+		struct keymap_cache_entry *entry = &keymap_cache.entries[i];
+		if (entry->keymap && entry->hash == hash && entry->size == size &&
+				memcmp(entry->text, text, size) == 0) {
+			entry->last_used = ++keymap_cache.clock;
+			return xkb_keymap_ref(entry->keymap);
+		}
+	}
+	return NULL;
+}
+
+static void keymap_cache_insert(uint64_t hash, const char *text, size_t size, struct xkb_keymap *keymap) {
+	struct keymap_cache_entry *entry = &keymap_cache.entries[0];
+	for (int i = 0; i < NWL_KEYMAP_CACHE_SIZE; i++) {
+		if (!keymap_cache.entries[i].keymap) {
+			entry = &keymap_cache.entries[i];
+			break;
+		}
+		if (keymap_cache.entries[i].last_used < entry->last_used) {
+			entry = &keymap_cache.entries[i];
+		}
+	}
+	if (entry->keymap) {
+		xkb_keymap_unref(entry->keymap);
+		free(entry->text);
+	}
+	entry->text = malloc(size);
+	memcpy(entry->text, text, size);
+	entry->size = size;
+	entry->hash = hash;
+	entry->keymap = xkb_keymap_ref(keymap);
+	entry->last_used = ++keymap_cache.clock;
+}
+
+static struct xkb_keymap *keymap_cache_get(struct nwl_core *core, const char *text, size_t size) {
+	uint64_t hash = hash_keymap(text, size);
+	pthread_mutex_lock(&keymap_cache.lock);
+	struct xkb_keymap *keymap = keymap_cache_lookup(hash, text, size);
+	pthread_mutex_unlock(&keymap_cache.lock);
+	if (keymap) {
+		return keymap;
+	}
+	keymap = xkb_keymap_new_from_buffer(get_xkb_context(core), text, size,
+		XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	nwl_core_startup_trace(core, "keymap compiled");
+	if (keymap) {
+		pthread_mutex_lock(&keymap_cache.lock);
+		keymap_cache_insert(hash, text, size, keymap);
+		pthread_mutex_unlock(&keymap_cache.lock);
+	}
+	return keymap;
+}
+
+void nwl_seat_keymap_cache_clear(void) {
+	pthread_mutex_lock(&keymap_cache.lock);
+	for (int i = 0; i < NWL_KEYMAP_CACHE_SIZE; i++) {
+		struct keymap_cache_entry *entry = &keymap_cache.entries[i];
+		if (entry->keymap) {
+			xkb_keymap_unref(entry->keymap);
+			free(entry->text);
+		}
+		*entry = (struct keymap_cache_entry){0};
+	}
+	pthread_mutex_unlock(&keymap_cache.lock);
+}
+
+// Keymaps that aren't cached are compiled on a worker thread, so dispatching doesn't stall.
+// Key and modifier events that come in meanwhile are held back and replayed once it's done.
+struct keymap_job {
+	pthread_t thread;
+	int done_fd;
+	char *text;
+	size_t size;
+	uint64_t hash;
+	bool want_compose;
+	struct xkb_keymap *keymap;
+	struct xkb_compose_table *compose_table;
+	struct wl_array held_events; // held_key_event
+};
+
+struct held_key_event {
+	bool modifiers;
+	uint32_t serial;
+	// key: time, key, state. modifiers: depressed, latched, locked, group
+	uint32_t args[4];
+};
+
+static void handle_keyboard_key(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
+	uint32_t time, uint32_t key, uint32_t state);
+static void handle_keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
+	uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group);
+
+static void *keymap_job_thread(void *data) {
+	struct keymap_job *job = data;
+	// xkb contexts aren't thread safe, so the job gets its own.
+	struct xkb_context *context = xkb_context_new(0);
+	job->keymap = xkb_keymap_new_from_buffer(context, job->text, job->size,
+		XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	if (job->keymap && job->want_compose) {
+		job->compose_table = xkb_compose_table_new_from_locale(context, get_env_locale(), 0);
+	}
+	xkb_context_unref(context);
+	uint64_t one = 1;
+	while (write(job->done_fd, &one, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		if (errno != EINTR) {
+			// The dispatch thread would never finish the job otherwise.
+			perror("nwl: keymap job done_fd");
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void keymap_job_free(struct keymap_job *job) {
+	wl_array_release(&job->held_events);
+	free(job->text);
+	free(job);
+}
+
+static bool keymap_job_hold_event(struct nwl_seat *seat, bool modifiers, uint32_t serial,
+		uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+	struct keymap_job *job = seat->keyboard_keymap_job;
+	if (!job) {
+		return false;
+	}
+	struct held_key_event *held = wl_array_add(&job->held_events, sizeof(struct held_key_event));
+	*held = (struct held_key_event) {
+		.modifiers = modifiers,
+		.serial = serial,
+		.args = { a, b, c, d }
+	};
+	return true;
+}
+
+// Waits for the job if it's not done yet, applies the keymap and replays held events.
+// The job wrote to the shared done fd before exiting, so after joining the count
+// is cleared here. Otherwise it would be left behind for the next job and
+// nwl_seat_handle_keymap would join that one before it's done.
+static void keymap_job_join(struct nwl_seat *seat, struct keymap_job *job) {
+	pthread_join(job->thread, NULL);
+	seat->keyboard_keymap_job = NULL;
+	uint64_t count;
+	if (read(job->done_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		// Only if the job's write failed, which it already complained about.
+		return;
+	}
+}
+
+static void keymap_job_finish(struct nwl_seat *seat) {
+	struct keymap_job *job = seat->keyboard_keymap_job;
+	keymap_job_join(seat, job);
+	if (job->compose_table) {
+		set_compose_table(seat->core, job->compose_table);
+	}
+	if (job->keymap) {
+		pthread_mutex_lock(&keymap_cache.lock);
+		keymap_cache_insert(job->hash, job->text, job->size, job->keymap);
+		seat->keyboard_xkb.keymap = job->keymap;
+		seat->keyboard_xkb.state = xkb_state_new(job->keymap);
+		pthread_mutex_unlock(&keymap_cache.lock);
+		nwl_core_startup_trace(seat->core, "keymap compiled");
+	}
+	struct held_key_event *held;
+	wl_array_for_each(held, &job->held_events) {
+		if (held->modifiers) {
+			handle_keyboard_modifiers(seat, seat->keyboard, held->serial,
+				held->args[0], held->args[1], held->args[2], held->args[3]);
+		} else {
+			handle_keyboard_key(seat, seat->keyboard, held->serial,
+				held->args[0], held->args[1], held->args[2]);
+		}
+	}
+	keymap_job_free(job);
+}
+
+static void keymap_job_cancel(struct nwl_seat *seat) {
+	struct keymap_job *job = seat->keyboard_keymap_job;
+	keymap_job_join(seat, job);
+	if (job->keymap) {
+		xkb_keymap_unref(job->keymap);
+	}
+	if (job->compose_table) {
+		xkb_compose_table_unref(job->compose_table);
+	}
+	keymap_job_free(job);
+}
+
+static bool keymap_job_start(struct nwl_seat *seat, const char *text, size_t size, uint64_t hash) {
+	struct keymap_job *job = calloc(1, sizeof(struct keymap_job));
+	job->done_fd = seat->keyboard_keymap_fd;
+	job->text = malloc(size);
+	memcpy(job->text, text, size);
+	job->size = size;
+	job->hash = hash;
+	// Only the first keymap job needs to bother with the compose table.
+	struct nwl_xkb_context *xkbsub = get_xkb_sub(seat->core);
+	job->want_compose = seat->keyboard_compose_enabled && !xkbsub->compose_tried && !xkbsub->compose_loading;
+	wl_array_init(&job->held_events);
+	if (pthread_create(&job->thread, NULL, keymap_job_thread, job) != 0) {
+		keymap_job_free(job);
+		return false;
+	}
+	seat->keyboard_keymap_job = job;
+	return true;
+}
+
+void nwl_seat_handle_keymap(struct nwl_seat *seat) {
+	uint64_t count;
+	// Nothing to read means the job was already finished synchronously.
+	if (read(seat->keyboard_keymap_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		return;
+	}
+	if (seat->keyboard_keymap_job) {
+		keymap_job_finish(seat);
+	}
+}
+
 static void handle_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard, uint32_t format,
 		int32_t fd, uint32_t size) {
 	UNUSED(wl_keyboard);
 	struct nwl_seat *seat = (struct nwl_seat*)data;
+	if (seat->keyboard_keymap_job) {
+		// Events held back belong to the previous keymap.
+		keymap_job_finish(seat);
+	}
 	unref_seat_xkb(seat);
 	if (format == WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP) {
 		return;
@@ -81,20 +411,41 @@ static void handle_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
 		return;
 	}
 	char *kbmap = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-	struct xkb_context *context = get_xkb_context(seat->core);
 	// -1 to remove the null termination
-	seat->keyboard_xkb.keymap = xkb_keymap_new_from_buffer(context, kbmap, size-1,
-		XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	uint64_t hash = hash_keymap(kbmap, size-1);
+	pthread_mutex_lock(&keymap_cache.lock);
+	seat->keyboard_xkb.keymap = keymap_cache_lookup(hash, kbmap, size-1);
+	pthread_mutex_unlock(&keymap_cache.lock);
+	if (!seat->keyboard_xkb.keymap &&
+			(!seat->keyboard_keymap_async || !keymap_job_start(seat, kbmap, size-1, hash))) {
+		// Nobody polling keyboard_keymap_fd, or no thread? Do it here then.
+		seat->keyboard_xkb.keymap = keymap_cache_get(seat->core, kbmap, size-1);
+	}
 	munmap(kbmap, size);
 	close(fd);
-
+	if (!seat->keyboard_xkb.keymap) {
+		return;
+	}
+	pthread_mutex_lock(&keymap_cache.lock);
 	seat->keyboard_xkb.state = xkb_state_new(seat->keyboard_xkb.keymap);
+	pthread_mutex_unlock(&keymap_cache.lock);
+	// The compose table is picked up when it's first needed, see ensure_compose_state.
+}
 
-	seat->keyboard_xkb.compose_table = xkb_compose_table_new_from_locale(context,
-		get_env_locale(), 0);
-	if (seat->keyboard_xkb.compose_table) {
-		seat->keyboard_xkb.compose_state = xkb_compose_state_new(seat->keyboard_xkb.compose_table, XKB_COMPOSE_STATE_NO_FLAGS);
+static bool ensure_compose_state(struct nwl_seat *seat) {
+	if (seat->keyboard_xkb.compose_state) {
+		return true;
+	}
+	if (!seat->keyboard_xkb.keymap) {
+		return false;
+	}
+	struct xkb_compose_table *table = get_compose_table(seat->core);
+	if (!table) {
+		return false;
 	}
+	seat->keyboard_xkb.compose_table = xkb_compose_table_ref(table);
+	seat->keyboard_xkb.compose_state = xkb_compose_state_new(table, XKB_COMPOSE_STATE_NO_FLAGS);
+	return true;
 }
 
 static void dispatch_keyboard_event(struct nwl_seat *seat) {
@@ -128,29 +479,86 @@ static void update_keyboard_event_compose(struct nwl_seat *seat) {
 	}
 }
 
+// Sym, compose and text of a pressed key, with the current modifiers.
+static void update_keyboard_event_text(struct nwl_seat *seat) {
+	struct nwl_keyboard_event *event = &seat->keyboard_event;
+	event->keysym = xkb_state_key_get_one_sym(seat->keyboard_xkb.state, event->keycode);
+	if (seat->keyboard_compose_enabled && ensure_compose_state(seat)) {
+		update_keyboard_event_compose(seat);
+	} else {
+		event->compose_state = NWL_KEYBOARD_COMPOSE_NONE;
+	}
+	if (event->compose_state != NWL_KEYBOARD_COMPOSE_COMPOSED) {
+		xkb_state_key_get_utf8(seat->keyboard_xkb.state, event->keycode, event->utf8, 16);
+	}
+}
+
+static void set_repeat_timer(struct nwl_seat *seat, bool pressed) {
+	struct itimerspec timer = { 0 };
+	// Rate is in repeats per second, delay in milliseconds. A rate of 0 means no repeating.
+	if (pressed && seat->keyboard_repeat_rate > 0) {
+		int64_t interval = 1000000000 / seat->keyboard_repeat_rate;
+		timer.it_value.tv_sec = seat->keyboard_repeat_delay / 1000;
+		timer.it_value.tv_nsec = (seat->keyboard_repeat_delay % 1000) * 1000000;
+		timer.it_interval.tv_sec = interval / 1000000000;
+		timer.it_interval.tv_nsec = interval % 1000000000;
+	}
+	timerfd_settime(seat->keyboard_repeat_fd, 0, &timer, NULL);
+}
+
+static const char *build_repeat_text(struct nwl_seat *seat, uint32_t count) {
+	const char *utf8 = seat->keyboard_event.utf8;
+	size_t len = strlen(utf8);
+	seat->keyboard_repeat_text.size = 0;
+	char *run = wl_array_add(&seat->keyboard_repeat_text, len * count + 1);
+	if (!run) {
+		return NULL;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(run + len * i, utf8, len);
+	}
+	run[len * count] = '\0';
+	return run;
+}
+
 void nwl_seat_handle_repeat(struct nwl_seat *seat) {
 	uint64_t expirations;
 	if (!seat->keyboard) {
 		return;
 	}
-	read(seat->keyboard_repeat_fd, &expirations, sizeof(uint64_t));
-	if (expirations == 0) {
+	if (read(seat->keyboard_repeat_fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t) || expirations == 0) {
 		return;
 	}
 	if (!seat->keyboard_repeat_enabled) {
-		struct itimerspec timer = { 0 };
-		timerfd_settime(seat->keyboard_repeat_fd, 0, &timer, NULL);
+		set_repeat_timer(seat, false);
 		return;
 	}
-	if (seat->keyboard_focus) {
-		seat->keyboard_event.type = NWL_KEYBOARD_EVENT_KEYREPEAT;
-		if (seat->keyboard_compose_enabled && seat->keyboard_xkb.compose_state) {
-			// Getting the sym here so the repeats go through the proper compose process
-			seat->keyboard_event.keysym = xkb_state_key_get_one_sym(seat->keyboard_xkb.state, seat->keyboard_event.keycode);
-			update_keyboard_event_compose(seat);
+	// Every expiration is a repeat, even the ones that passed while we were busy.
+	// But not more than a second's worth, after a long stall that's not what anyone wants.
+	struct nwl_keyboard_event *event = &seat->keyboard_event;
+	uint32_t max_count = seat->keyboard_repeat_rate > 0 ? (uint32_t)seat->keyboard_repeat_rate : 1;
+	uint32_t count = expirations > max_count ? max_count : expirations;
+	while (count > 0 && seat->keyboard_focus) {
+		event->type = NWL_KEYBOARD_EVENT_KEYREPEAT;
+		event->repeat_count = 1;
+		event->repeat_text = NULL;
+		if (seat->keyboard_xkb.state) {
+			update_keyboard_event_text(seat);
 		}
+		// Plain text repeats the same every time, so it can all go in one go.
+		// Anything going through compose has to be fed one at a time.
+		if (seat->keyboard_repeat_coalesce && count > 1 && event->utf8[0] &&
+				event->compose_state == NWL_KEYBOARD_COMPOSE_NONE) {
+			event->repeat_text = build_repeat_text(seat, count);
+			if (event->repeat_text) {
+				event->repeat_count = count;
+			}
+		}
+		count -= event->repeat_count;
 		dispatch_keyboard_event(seat);
 	}
+	event->repeat_count = 0;
+	event->repeat_text = NULL;
 }
 
 static void handle_keyboard_enter(
@@ -184,13 +592,69 @@ static void handle_keyboard_leave(
 	if (!seat->keyboard_focus) {
 		return;
 	}
+	if (seat->keyboard_keymap_job) {
+		// Held back keys went to this surface, so they can't wait any longer.
+		keymap_job_finish(seat);
+	}
 	seat->keyboard_event.serial = serial;
 	seat->keyboard_event.focus = false;
 	seat->keyboard_event.type = NWL_KEYBOARD_EVENT_FOCUS;
 	dispatch_keyboard_event(seat);
 	seat->keyboard_focus = NULL;
-	struct itimerspec timer = { 0 };
-	timerfd_settime(seat->keyboard_repeat_fd, 0, &timer, NULL);
+	seat->keybind_state = 0;
+	// No releases come after leave.
+	seat->keybind_keys.size = 0;
+	set_repeat_timer(seat, false);
+}
+
+static bool handle_keybind(struct nwl_seat *seat) {
+	nwl_keybind_callback_t callback;
+	void *data;
+	xkb_keycode_t keycode = seat->keyboard_event.keycode;
+	const xkb_keysym_t *syms;
+	xkb_layout_index_t layout = xkb_state_key_get_layout(seat->keyboard_xkb.state, keycode);
+	xkb_keysym_t base = xkb_keymap_key_get_syms_by_level(seat->keyboard_xkb.keymap, keycode, layout, 0, &syms) > 0 ?
+		syms[0] : XKB_KEY_NoSymbol;
+	if (!nwl_keybinds_lookup(seat->keybinds, &seat->keybind_state, seat->keybind_mods,
+			seat->keyboard_event.keysym, base, &callback, &data)) {
+		return false;
+	}
+	// Bound keys don't repeat, and whatever was repeating stops.
+	set_repeat_timer(seat, false);
+	if (callback) {
+		callback(seat, seat->keyboard_focus, data);
+	}
+	return true;
+}
+
+static bool take_keybind_key(struct nwl_seat *seat, uint32_t key) {
+	uint32_t *keys = seat->keybind_keys.data;
+	size_t n = seat->keybind_keys.size / sizeof(uint32_t);
+	for (size_t i = 0; i < n; i++) {
+		if (keys[i] == key) {
+			keys[i] = keys[n - 1];
+			seat->keybind_keys.size -= sizeof(uint32_t);
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint32_t get_keybind_mods(struct xkb_state *state) {
+	uint32_t mods = 0;
+	if (xkb_state_mod_name_is_active(state, XKB_MOD_NAME_CTRL, XKB_STATE_MODS_EFFECTIVE) > 0) {
+		mods |= NWL_KEYBIND_MOD_CTRL;
+	}
+	if (xkb_state_mod_name_is_active(state, XKB_MOD_NAME_SHIFT, XKB_STATE_MODS_EFFECTIVE) > 0) {
+		mods |= NWL_KEYBIND_MOD_SHIFT;
+	}
+	if (xkb_state_mod_name_is_active(state, XKB_MOD_NAME_ALT, XKB_STATE_MODS_EFFECTIVE) > 0) {
+		mods |= NWL_KEYBIND_MOD_ALT;
+	}
+	if (xkb_state_mod_name_is_active(state, XKB_MOD_NAME_LOGO, XKB_STATE_MODS_EFFECTIVE) > 0) {
+		mods |= NWL_KEYBIND_MOD_SUPER;
+	}
+	return mods;
 }
 
 static void handle_keyboard_key(
@@ -201,9 +665,8 @@ static void handle_keyboard_key(
 		uint32_t key,
 		uint32_t state) {
 	UNUSED(wl_keyboard);
-	UNUSED(time);
 	struct nwl_seat *seat = (struct nwl_seat*)data;
-	if (!seat->keyboard_focus) {
+	if (!seat->keyboard_focus || keymap_job_hold_event(seat, false, serial, time, key, state, 0)) {
 		return;
 	}
 	struct nwl_keyboard_event *event = &seat->keyboard_event;
@@ -211,17 +674,22 @@ static void handle_keyboard_key(
 	if (seat->keyboard_xkb.state) {
 		event->keysym = xkb_state_key_get_one_sym(seat->keyboard_xkb.state, event->keycode);
 	}
+	// A key a keybind took stays taken until it's released, input_keyboard never sees either.
+	if (state == WL_KEYBOARD_KEY_STATE_PRESSED && seat->keybinds && seat->keyboard_xkb.state &&
+			handle_keybind(seat)) {
+		uint32_t *bound = wl_array_add(&seat->keybind_keys, sizeof(uint32_t));
+		if (bound) {
+			*bound = key;
+		}
+		return;
+	}
+	if (state == WL_KEYBOARD_KEY_STATE_RELEASED && take_keybind_key(seat, key)) {
+		return;
+	}
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		event->type = NWL_KEYBOARD_EVENT_KEYDOWN;
 		if (seat->keyboard_xkb.state) {
-			if (seat->keyboard_xkb.compose_state && seat->keyboard_compose_enabled) {
-				update_keyboard_event_compose(seat);
-			} else {
-				event->compose_state = NWL_KEYBOARD_COMPOSE_NONE;
-			}
-			if (event->compose_state != NWL_KEYBOARD_COMPOSE_COMPOSED) {
-				xkb_state_key_get_utf8(seat->keyboard_xkb.state, event->keycode, event->utf8, 16);
-			}
+			update_keyboard_event_text(seat);
 		}
 	} else {
 		event->type = NWL_KEYBOARD_EVENT_KEYUP;
@@ -231,12 +699,7 @@ static void handle_keyboard_key(
 	if (seat->keyboard_repeat_enabled && seat->keyboard_repeat_delay > 0 &&
 			(seat->keyboard_xkb.keymap == NULL ||
 			xkb_keymap_key_repeats(seat->keyboard_xkb.keymap, event->keycode))) {
-		struct itimerspec timer = { 0 };
-		if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-			timer.it_value.tv_nsec = seat->keyboard_repeat_delay * 1000000;
-			timer.it_interval.tv_nsec = seat->keyboard_repeat_rate * 1000000;
-		}
-		timerfd_settime(seat->keyboard_repeat_fd, 0, &timer, NULL);
+		set_repeat_timer(seat, state == WL_KEYBOARD_KEY_STATE_PRESSED);
 	}
 }
 
@@ -250,11 +713,15 @@ static void handle_keyboard_modifiers(
 		uint32_t group) {
 	UNUSED(wl_keyboard);
 	struct nwl_seat *seat = (struct nwl_seat*)data;
+	if (keymap_job_hold_event(seat, true, serial, mods_depressed, mods_latched, mods_locked, group)) {
+		return;
+	}
 	struct nwl_keyboard_event *event = &seat->keyboard_event;
 	event->serial = serial;
 	event->type = NWL_KEYBOARD_EVENT_MODIFIERS;
 	if (seat->keyboard_xkb.state) {
 		xkb_state_update_mask(seat->keyboard_xkb.state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+		seat->keybind_mods = get_keybind_mods(seat->keyboard_xkb.state);
 		// This can happen without keyboard focus!
 		if (seat->keyboard_focus) {
 			dispatch_keyboard_event(seat);
@@ -271,6 +738,9 @@ static void handle_keyboard_repeat(
 	struct nwl_seat *seat = (struct nwl_seat*)data;
 	seat->keyboard_repeat_rate = rate;
 	seat->keyboard_repeat_delay = delay;
+	if (rate == 0) {
+		set_repeat_timer(seat, false);
+	}
 }
 
 static const struct wl_keyboard_listener keyboard_listener = {
@@ -339,8 +809,177 @@ void nwl_seat_set_pointer_shape(struct nwl_seat *seat, enum wp_cursor_shape_devi
 	}
 }
 
+// Loaded xcursor themes, one per scale. Kept around until the core goes away,
+// so moving between outputs of different scales doesn't reload anything, and the
+// wl_buffers the images made stay around for reuse.
+struct nwl_cursor_themes {
+	struct nwl_core_sub sub;
+	struct wl_list themes; // nwl_cursor_theme_entry
+};
+
+struct nwl_cursor_theme_entry {
+	struct wl_list link;
+	pthread_t thread;
+	struct wl_shm *shm;
+	struct wl_cursor_theme *theme;
+	int32_t scale;
+	atomic_bool loaded; // Set by the thread once theme is there, join can't block after
+	bool joined;
+};
+
+static void cursor_theme_join(struct nwl_cursor_theme_entry *entry) {
+	if (!entry->joined) {
+		pthread_join(entry->thread, NULL);
+		entry->joined = true;
+	}
+}
+
+static void cursor_themes_sub_destroy(struct nwl_core_sub *sub) {
+	struct nwl_cursor_themes *themes = wl_container_of(sub, themes, sub);
+	struct nwl_cursor_theme_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &themes->themes, link) {
+		cursor_theme_join(entry);
+		if (entry->theme) {
+			wl_cursor_theme_destroy(entry->theme);
+		}
+		free(entry);
+	}
+	free(themes);
+}
+
+static const struct nwl_core_sub_impl cursor_themes_sub_impl = {
+	cursor_themes_sub_destroy
+};
+
+static void *cursor_theme_thread(void *data) {
+	struct nwl_cursor_theme_entry *entry = data;
+	entry->theme = wl_cursor_theme_load(NULL, 24 * entry->scale, entry->shm);
+	atomic_store(&entry->loaded, true);
+	return NULL;
+}
+
+static struct nwl_cursor_themes *get_cursor_themes(struct nwl_core *core) {
+	struct nwl_core_sub *sub = nwl_core_get_sub(core, &cursor_themes_sub_impl);
+	if (sub) {
+		struct nwl_cursor_themes *themes = wl_container_of(sub, themes, sub);
+		return themes;
+	}
+	struct nwl_cursor_themes *themes = calloc(1, sizeof(struct nwl_cursor_themes));
+	themes->sub.impl = &cursor_themes_sub_impl;
+	wl_list_init(&themes->themes);
+	nwl_core_add_sub(core, &themes->sub);
+	return themes;
+}
+
+static struct nwl_cursor_theme_entry *find_cursor_theme(struct nwl_cursor_themes *themes, int32_t scale) {
+	struct nwl_cursor_theme_entry *entry;
+	wl_list_for_each(entry, &themes->themes, link) {
+		if (entry->scale == scale) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+void nwl_cursor_theme_prewarm(struct nwl_core *core, int32_t scale) {
+	if (!core->wl.shm) {
+		return;
+	}
+	struct nwl_cursor_themes *themes = get_cursor_themes(core);
+	if (find_cursor_theme(themes, scale)) {
+		return;
+	}
+	struct nwl_cursor_theme_entry *entry = calloc(1, sizeof(struct nwl_cursor_theme_entry));
+	entry->shm = core->wl.shm;
+	entry->scale = scale;
+	atomic_init(&entry->loaded, false);
+	if (pthread_create(&entry->thread, NULL, cursor_theme_thread, entry) != 0) {
+		free(entry);
+		return;
+	}
+	wl_list_insert(&themes->themes, &entry->link);
+}
+
+// Never waits on a load. Starts one in the background if this scale is new, and meanwhile
+// hands out the closest scale that is ready, if any. theme_scale is what it actually is.
+static struct wl_cursor_theme *get_cursor_theme(struct nwl_core *core, int32_t scale, int32_t *theme_scale) {
+	nwl_cursor_theme_prewarm(core, scale);
+	struct nwl_cursor_themes *themes = get_cursor_themes(core);
+	struct nwl_cursor_theme_entry *entry, *best = NULL;
+	wl_list_for_each(entry, &themes->themes, link) {
+		if (!atomic_load(&entry->loaded) || !entry->theme) {
+			continue;
+		}
+		if (!best || abs(entry->scale - scale) < abs(best->scale - scale) ||
+				(abs(entry->scale - scale) == abs(best->scale - scale) && entry->scale > best->scale)) {
+			best = entry;
+		}
+	}
+	if (!best) {
+		return NULL;
+	}
+	if (!best->joined) {
+		nwl_core_startup_trace(core, "cursor theme loaded");
+	}
+	cursor_theme_join(best);
+	*theme_scale = best->scale;
+	return best->theme;
+}
+
+// How often to check back on a cursor theme that's still loading.
+#define XCURSOR_PENDING_RETRY_MS 16
+
+static void attach_xcursor_image(struct nwl_seat *seat, struct wl_cursor_image *image) {
+	struct wl_surface *wl_surface = seat->pointer_surface.xcursor_surface;
+	// libwayland-cursor makes the buffer once per image and hands the same one out after.
+	wl_surface_attach(wl_surface, wl_cursor_image_get_buffer(image), 0, 0);
+	wl_surface_damage_buffer(wl_surface, 0, 0, INT32_MAX, INT32_MAX);
+}
+
+// Arms the timer for the next image, 0 stops it.
+static void set_xcursor_timer(struct nwl_seat *seat, uint32_t delay_ms) {
+	struct itimerspec timer = {
+		.it_value.tv_sec = delay_ms / 1000,
+		.it_value.tv_nsec = (delay_ms % 1000) * 1000000
+	};
+	timerfd_settime(seat->pointer_surface.xcursor_fd, 0, &timer, NULL);
+}
+
+static void stop_xcursor_animation(struct nwl_seat *seat) {
+	set_xcursor_timer(seat, 0);
+	free(seat->pointer_surface.xcursor_pending);
+	seat->pointer_surface.xcursor_pending = NULL;
+}
+
+void nwl_seat_handle_xcursor(struct nwl_seat *seat) {
+	uint64_t expirations;
+	if (read(seat->pointer_surface.xcursor_fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		return;
+	}
+	if (seat->pointer_surface.xcursor_pending) {
+		// See if the theme for the right scale is in yet.
+		char *pending = seat->pointer_surface.xcursor_pending;
+		seat->pointer_surface.xcursor_pending = NULL;
+		nwl_seat_set_pointer_cursor(seat, pending);
+		free(pending);
+		return;
+	}
+	struct wl_cursor *xcursor = seat->pointer_surface.xcursor;
+	if (!xcursor || xcursor->image_count < 2 || !seat->pointer_surface.xcursor_surface) {
+		return;
+	}
+	// Only commit when the image actually changes, at the pace the theme asks for.
+	int image = (seat->pointer_surface.xcursor_image + 1) % xcursor->image_count;
+	seat->pointer_surface.xcursor_image = image;
+	attach_xcursor_image(seat, xcursor->images[image]);
+	wl_surface_commit(seat->pointer_surface.xcursor_surface);
+	set_xcursor_timer(seat, xcursor->images[image]->delay);
+}
+
 void nwl_seat_set_pointer_cursor(struct nwl_seat *seat, const char *cursor) {
+	stop_xcursor_animation(seat);
 	if (cursor == NULL) {
+		seat->pointer_surface.xcursor = NULL;
 		wl_pointer_set_cursor(seat->pointer, seat->pointer_event.serial, NULL, 0, 0);
 		return;
 	}
@@ -351,26 +990,35 @@ void nwl_seat_set_pointer_cursor(struct nwl_seat *seat, const char *cursor) {
 	if (!seat->pointer_surface.xcursor_surface) {
 		seat->pointer_surface.xcursor_surface = wl_compositor_create_surface(seat->core->wl.compositor);
 	}
-	if ((int)seat->core->cursor_theme_size != surface->scale*24) {
-		if (seat->core->cursor_theme) {
-			wl_cursor_theme_destroy(seat->core->cursor_theme);
+	int32_t scale = surface->scale;
+	struct wl_cursor_theme *theme = get_cursor_theme(seat->core, surface->scale, &scale);
+	if (scale != surface->scale || !theme) {
+		// Right scale is still loading, try again shortly.
+		seat->pointer_surface.xcursor_pending = strdup(cursor);
+		set_xcursor_timer(seat, XCURSOR_PENDING_RETRY_MS);
+		if (!theme) {
+			return;
 		}
-		seat->core->cursor_theme = wl_cursor_theme_load(NULL, 24 * surface->scale, seat->core->wl.shm);
-		seat->core->cursor_theme_size = 24 * surface->scale;
-		wl_surface_set_buffer_scale(seat->pointer_surface.xcursor_surface, surface->scale);
 	}
-	struct wl_cursor *xcursor = wl_cursor_theme_get_cursor(seat->core->cursor_theme, cursor);
+	struct wl_cursor *xcursor = wl_cursor_theme_get_cursor(theme, cursor);
 	if (!xcursor) {
 		return;
 	}
-	struct wl_buffer *cursbuffer = wl_cursor_image_get_buffer(xcursor->images[0]);
-	wl_surface_attach(seat->pointer_surface.xcursor_surface, cursbuffer, 0, 0);
-	wl_surface_damage_buffer(seat->pointer_surface.xcursor_surface, 0, 0, INT32_MAX, INT32_MAX);
+	if (seat->pointer_surface.xcursor_scale != scale) {
+		seat->pointer_surface.xcursor_scale = scale;
+		wl_surface_set_buffer_scale(seat->pointer_surface.xcursor_surface, scale);
+	}
+	seat->pointer_surface.xcursor = xcursor;
+	seat->pointer_surface.xcursor_image = 0;
+	attach_xcursor_image(seat, xcursor->images[0]);
 	wl_surface_commit(seat->pointer_surface.xcursor_surface);
+	if (!seat->pointer_surface.xcursor_pending) {
+		set_xcursor_timer(seat, xcursor->image_count > 1 ? xcursor->images[0]->delay : 0);
+	}
 	seat->pointer_surface.nwl = NULL;
 	// Divide hotspot by scale, why? Because the compositor multiplies it by the scale!
-	int32_t hot_x = xcursor->images[0]->hotspot_x/surface->scale;
-	int32_t hot_y = xcursor->images[0]->hotspot_y/surface->scale;
+	int32_t hot_x = xcursor->images[0]->hotspot_x/scale;
+	int32_t hot_y = xcursor->images[0]->hotspot_y/scale;
 	wl_pointer_set_cursor(seat->pointer, seat->pointer_event.serial, seat->pointer_surface.xcursor_surface,
 		hot_x, hot_y);
 }
@@ -401,6 +1049,8 @@ bool nwl_seat_set_pointer_surface(struct nwl_seat *seat, struct nwl_surface *sur
 		wl_surface_commit(surface->wl.surface);
 	}
 	seat->pointer_surface.nwl = surface;
+	stop_xcursor_animation(seat);
+	seat->pointer_surface.xcursor = NULL;
 	wl_pointer_set_cursor(seat->pointer, seat->pointer_event.serial, surface->wl.surface, hotspot_x, hotspot_y);
 	if (surface) {
 		nwl_surface_set_need_update(surface, true);
@@ -435,6 +1085,8 @@ static void handle_pointer_leave(void *data, struct wl_pointer *pointer, uint32_
 	UNUSED(pointer);
 	UNUSED(surface);
 	struct nwl_seat *seat = (struct nwl_seat*)data;
+	// The compositor hides the cursor now, no point animating it. Enter sets it again.
+	stop_xcursor_animation(seat);
 	if (seat->pointer_focus) {
 		seat->pointer_event.serial = serial;
 		seat->pointer_event.focus = false;
@@ -442,14 +1094,68 @@ static void handle_pointer_leave(void *data, struct wl_pointer *pointer, uint32_
 	}
 }
 
+bool nwl_seat_set_pointer_history(struct nwl_seat *seat, uint32_t capacity) {
+	struct nwl_pointer_history *history = &seat->pointer_history;
+	free(history->samples);
+	*history = (struct nwl_pointer_history){0};
+	if (capacity == 0) {
+		return true;
+	}
+	uint32_t size = 1;
+	while (size < capacity) {
+		if (size > UINT32_MAX / 2) {
+			return false;
+		}
+		size *= 2;
+	}
+	history->samples = malloc(sizeof(struct nwl_pointer_sample) * size);
+	if (!history->samples) {
+		return false;
+	}
+	history->capacity = size;
+	return true;
+}
+
+uint32_t nwl_seat_drain_pointer_history(struct nwl_seat *seat, struct nwl_pointer_sample *samples, uint32_t max) {
+	struct nwl_pointer_history *history = &seat->pointer_history;
+	uint32_t n = history->count < max ? history->count : max;
+	for (uint32_t i = 0; i < n; i++) {
+		samples[i] = history->samples[(history->head + i) & (history->capacity - 1)];
+	}
+	history->head = (history->head + n) & (history->capacity - 1);
+	history->count -= n;
+	return n;
+}
+
+static void push_pointer_sample(struct nwl_seat *seat, uint32_t time) {
+	struct nwl_pointer_history *history = &seat->pointer_history;
+	uint32_t mask = history->capacity - 1;
+	if (history->count == history->capacity) {
+		// Full, the oldest goes.
+		history->head = (history->head + 1) & mask;
+		history->count--;
+		history->overwritten++;
+	}
+	history->samples[(history->head + history->count) & mask] = (struct nwl_pointer_sample) {
+		.time = time,
+		.surface_x = seat->pointer_event.surface_x,
+		.surface_y = seat->pointer_event.surface_y,
+		.surface = seat->pointer_focus,
+		.buttons = seat->pointer_event.buttons,
+	};
+	history->count++;
+}
+
 static void handle_pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time,
 		wl_fixed_t surface_x, wl_fixed_t surface_y) {
 	UNUSED(wl_pointer);
-	UNUSED(time);
 	struct nwl_seat *seat = (struct nwl_seat*)data;
 	seat->pointer_event.changed |= NWL_POINTER_EVENT_MOTION;
 	seat->pointer_event.surface_x = surface_x;
 	seat->pointer_event.surface_y = surface_y;
+	if (seat->pointer_history.capacity) {
+		push_pointer_sample(seat, time);
+	}
 }
 
 static char map_linuxmbutton_to_nwl(uint32_t button) {
@@ -605,7 +1311,354 @@ static const struct wl_pointer_listener pointer_listener = {
 	handle_pointer_axis_discrete,
 	handle_pointer_axis_value120
 };
-/*
+
+#define NWL_TABLET_MAX_SAMPLES 256
+
+void nwl_seat_flush_tablet(struct nwl_seat *seat) {
+	uint32_t num = seat->tablet.samples.size / sizeof(struct nwl_tablet_sample);
+	if (num == 0) {
+		return;
+	}
+	struct nwl_surface *surface = seat->tablet.pending_focus;
+	struct nwl_tablet_tool *tool = seat->tablet.pending_tool;
+	if (surface && surface->impl.input_tablet) {
+		struct nwl_tablet_event event = {
+			.tool = tool,
+			.samples = seat->tablet.samples.data,
+			.num_samples = num,
+			.serial = tool->serial,
+		};
+		surface->impl.input_tablet(surface, seat, &event);
+	}
+	seat->tablet.samples.size = 0;
+}
+
+static void queue_tablet_sample(struct nwl_seat *seat, struct nwl_tablet_tool *tool) {
+	if (seat->tablet.pending_tool != tool || seat->tablet.pending_focus != tool->focus ||
+			seat->tablet.samples.size == NWL_TABLET_MAX_SAMPLES * sizeof(struct nwl_tablet_sample)) {
+		nwl_seat_flush_tablet(seat);
+	}
+	seat->tablet.pending_tool = tool;
+	seat->tablet.pending_focus = tool->focus;
+	struct nwl_tablet_sample *sample = wl_array_add(&seat->tablet.samples, sizeof(struct nwl_tablet_sample));
+	if (sample) {
+		*sample = tool->state;
+	}
+}
+
+static void handle_tablet_tool_type(void *data, struct zwp_tablet_tool_v2 *wl_tool, uint32_t tool_type) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->type = tool_type;
+}
+
+static void handle_tablet_tool_hardware_serial(void *data, struct zwp_tablet_tool_v2 *wl_tool,
+		uint32_t serial_hi, uint32_t serial_lo) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->hardware_serial = (uint64_t)serial_hi << 32 | serial_lo;
+}
+
+static void handle_tablet_tool_hardware_id_wacom(void *data, struct zwp_tablet_tool_v2 *wl_tool,
+		uint32_t id_hi, uint32_t id_lo) {
+	UNUSED(data);
+	UNUSED(wl_tool);
+	UNUSED(id_hi);
+	UNUSED(id_lo);
+}
+
+static void handle_tablet_tool_capability(void *data, struct zwp_tablet_tool_v2 *wl_tool, uint32_t capability) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->capabilities |= 1 << capability;
+}
+
+static void handle_tablet_tool_done(void *data, struct zwp_tablet_tool_v2 *wl_tool) {
+	UNUSED(data);
+	UNUSED(wl_tool);
+}
+
+static void destroy_tablet_tool(struct nwl_tablet_tool *tool) {
+	struct nwl_seat *seat = tool->seat;
+	if (seat->tablet.pending_tool == tool) {
+		nwl_seat_flush_tablet(seat);
+		seat->tablet.pending_tool = NULL;
+		seat->tablet.pending_focus = NULL;
+	}
+	wl_list_remove(&tool->link);
+	zwp_tablet_tool_v2_destroy(tool->wl);
+	free(tool);
+}
+
+static void handle_tablet_tool_removed(void *data, struct zwp_tablet_tool_v2 *wl_tool) {
+	UNUSED(wl_tool);
+	destroy_tablet_tool(data);
+}
+
+static void handle_tablet_tool_proximity_in(void *data, struct zwp_tablet_tool_v2 *wl_tool,
+		uint32_t serial, struct zwp_tablet_v2 *tablet, struct wl_surface *surface) {
+	UNUSED(wl_tool);
+	UNUSED(tablet);
+	if (!surface) {
+		return;
+	}
+	struct nwl_tablet_tool *tool = data;
+	tool->focus = wl_surface_get_user_data(surface);
+	tool->serial = serial;
+	tool->state.proximity = true;
+	tool->state.changed |= NWL_TABLET_PROXIMITY;
+}
+
+static void handle_tablet_tool_proximity_out(void *data, struct zwp_tablet_tool_v2 *wl_tool) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.proximity = false;
+	tool->state.down = false;
+	tool->state.buttons = 0;
+	tool->state.changed |= NWL_TABLET_PROXIMITY;
+}
+
+static void handle_tablet_tool_down(void *data, struct zwp_tablet_tool_v2 *wl_tool, uint32_t serial) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->serial = serial;
+	tool->state.down = true;
+	tool->state.changed |= NWL_TABLET_TIP;
+}
+
+static void handle_tablet_tool_up(void *data, struct zwp_tablet_tool_v2 *wl_tool) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.down = false;
+	tool->state.changed |= NWL_TABLET_TIP;
+}
+
+static void handle_tablet_tool_motion(void *data, struct zwp_tablet_tool_v2 *wl_tool, wl_fixed_t x, wl_fixed_t y) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.surface_x = x;
+	tool->state.surface_y = y;
+	tool->state.changed |= NWL_TABLET_MOTION;
+}
+
+static void handle_tablet_tool_pressure(void *data, struct zwp_tablet_tool_v2 *wl_tool, uint32_t pressure) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.pressure = pressure;
+	tool->state.changed |= NWL_TABLET_PRESSURE;
+}
+
+static void handle_tablet_tool_distance(void *data, struct zwp_tablet_tool_v2 *wl_tool, uint32_t distance) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.distance = distance;
+	tool->state.changed |= NWL_TABLET_DISTANCE;
+}
+
+static void handle_tablet_tool_tilt(void *data, struct zwp_tablet_tool_v2 *wl_tool, wl_fixed_t tilt_x, wl_fixed_t tilt_y) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.tilt_x = tilt_x;
+	tool->state.tilt_y = tilt_y;
+	tool->state.changed |= NWL_TABLET_TILT;
+}
+
+static void handle_tablet_tool_rotation(void *data, struct zwp_tablet_tool_v2 *wl_tool, wl_fixed_t degrees) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.rotation = degrees;
+	tool->state.changed |= NWL_TABLET_ROTATION;
+}
+
+static void handle_tablet_tool_slider(void *data, struct zwp_tablet_tool_v2 *wl_tool, int32_t position) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.slider = position;
+	tool->state.changed |= NWL_TABLET_SLIDER;
+}
+
+static void handle_tablet_tool_wheel(void *data, struct zwp_tablet_tool_v2 *wl_tool, wl_fixed_t degrees, int32_t clicks) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.wheel += degrees;
+	tool->state.wheel_clicks += clicks;
+	tool->state.changed |= NWL_TABLET_WHEEL;
+}
+
+static unsigned char map_tablet_button_to_nwl(uint32_t button) {
+	switch (button) {
+		case BTN_STYLUS:
+			return NWL_TABLET_BUTTON_STYLUS;
+		case BTN_STYLUS2:
+			return NWL_TABLET_BUTTON_STYLUS2;
+		case BTN_STYLUS3:
+			return NWL_TABLET_BUTTON_STYLUS3;
+		default:
+			return 0;
+	}
+}
+
+static void handle_tablet_tool_button(void *data, struct zwp_tablet_tool_v2 *wl_tool,
+		uint32_t serial, uint32_t button, uint32_t state) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->serial = serial;
+	if (state == ZWP_TABLET_TOOL_V2_BUTTON_STATE_PRESSED) {
+		tool->state.buttons |= map_tablet_button_to_nwl(button);
+	} else {
+		tool->state.buttons &= ~map_tablet_button_to_nwl(button);
+	}
+	tool->state.changed |= NWL_TABLET_BUTTON;
+}
+
+static void handle_tablet_tool_frame(void *data, struct zwp_tablet_tool_v2 *wl_tool, uint32_t time) {
+	UNUSED(wl_tool);
+	struct nwl_tablet_tool *tool = data;
+	tool->state.time = time;
+	if (tool->focus) {
+		// Not dispatched right away, high rate tablets would have the app do a lot of work for nothing.
+		queue_tablet_sample(tool->seat, tool);
+	}
+	if (!tool->state.proximity) {
+		tool->focus = NULL;
+	}
+	tool->state.changed = 0;
+	tool->state.wheel = 0;
+	tool->state.wheel_clicks = 0;
+}
+
+static const struct zwp_tablet_tool_v2_listener tablet_tool_listener = {
+	handle_tablet_tool_type,
+	handle_tablet_tool_hardware_serial,
+	handle_tablet_tool_hardware_id_wacom,
+	handle_tablet_tool_capability,
+	handle_tablet_tool_done,
+	handle_tablet_tool_removed,
+	handle_tablet_tool_proximity_in,
+	handle_tablet_tool_proximity_out,
+	handle_tablet_tool_down,
+	handle_tablet_tool_up,
+	handle_tablet_tool_motion,
+	handle_tablet_tool_pressure,
+	handle_tablet_tool_distance,
+	handle_tablet_tool_tilt,
+	handle_tablet_tool_rotation,
+	handle_tablet_tool_slider,
+	handle_tablet_tool_wheel,
+	handle_tablet_tool_button,
+	handle_tablet_tool_frame
+};
+
+static void handle_tablet_name(void *data, struct zwp_tablet_v2 *tablet, const char *name) {
+	UNUSED(data);
+	UNUSED(tablet);
+	UNUSED(name);
+}
+
+static void handle_tablet_id(void *data, struct zwp_tablet_v2 *tablet, uint32_t vid, uint32_t pid) {
+	UNUSED(data);
+	UNUSED(tablet);
+	UNUSED(vid);
+	UNUSED(pid);
+}
+
+static void handle_tablet_path(void *data, struct zwp_tablet_v2 *tablet, const char *path) {
+	UNUSED(data);
+	UNUSED(tablet);
+	UNUSED(path);
+}
+
+static void handle_tablet_done(void *data, struct zwp_tablet_v2 *tablet) {
+	UNUSED(data);
+	UNUSED(tablet);
+}
+
+static void handle_tablet_removed(void *data, struct zwp_tablet_v2 *tablet) {
+	struct nwl_seat *seat = data;
+	struct zwp_tablet_v2 **tab;
+	wl_array_for_each(tab, &seat->tablet.tablets) {
+		if (*tab == tablet) {
+			// Swap with the last one
+			struct zwp_tablet_v2 **last = (struct zwp_tablet_v2**)
+				((char*)seat->tablet.tablets.data + seat->tablet.tablets.size) - 1;
+			*tab = *last;
+			seat->tablet.tablets.size -= sizeof(struct zwp_tablet_v2*);
+			break;
+		}
+	}
+	zwp_tablet_v2_destroy(tablet);
+}
+
+static const struct zwp_tablet_v2_listener tablet_listener = {
+	handle_tablet_name,
+	handle_tablet_id,
+	handle_tablet_path,
+	handle_tablet_done,
+	handle_tablet_removed
+};
+
+static void handle_tablet_seat_tablet_added(void *data, struct zwp_tablet_seat_v2 *tablet_seat,
+		struct zwp_tablet_v2 *tablet) {
+	UNUSED(tablet_seat);
+	struct nwl_seat *seat = data;
+	// Nothing interesting in here, but the tools refer to it so it has to stick around.
+	struct zwp_tablet_v2 **dest = wl_array_add(&seat->tablet.tablets, sizeof(struct zwp_tablet_v2*));
+	*dest = tablet;
+	zwp_tablet_v2_add_listener(tablet, &tablet_listener, seat);
+}
+
+static void handle_tablet_seat_tool_added(void *data, struct zwp_tablet_seat_v2 *tablet_seat,
+		struct zwp_tablet_tool_v2 *wl_tool) {
+	UNUSED(tablet_seat);
+	struct nwl_seat *seat = data;
+	struct nwl_tablet_tool *tool = calloc(1, sizeof(struct nwl_tablet_tool));
+	tool->seat = seat;
+	tool->wl = wl_tool;
+	wl_list_insert(&seat->tablet.tools, &tool->link);
+	zwp_tablet_tool_v2_add_listener(wl_tool, &tablet_tool_listener, tool);
+}
+
+static void handle_tablet_seat_pad_added(void *data, struct zwp_tablet_seat_v2 *tablet_seat,
+		struct zwp_tablet_pad_v2 *pad) {
+	UNUSED(data);
+	UNUSED(tablet_seat);
+	// Pads aren't supported (yet?)
+	zwp_tablet_pad_v2_destroy(pad);
+}
+
+static const struct zwp_tablet_seat_v2_listener tablet_seat_listener = {
+	handle_tablet_seat_tablet_added,
+	handle_tablet_seat_tool_added,
+	handle_tablet_seat_pad_added
+};
+
+void nwl_seat_add_tablet_seat(struct nwl_seat *seat) {
+	seat->tablet.wl = zwp_tablet_manager_v2_get_tablet_seat(seat->core->wl.tablet_manager, seat->wl_seat);
+	zwp_tablet_seat_v2_add_listener(seat->tablet.wl, &tablet_seat_listener, seat);
+}
+
+static void seat_release_tablet(struct nwl_seat *seat) {
+	while (!wl_list_empty(&seat->tablet.tools)) {
+		struct nwl_tablet_tool *tool = wl_container_of(seat->tablet.tools.next, tool, link);
+		destroy_tablet_tool(tool);
+	}
+	struct zwp_tablet_v2 **tab;
+	wl_array_for_each(tab, &seat->tablet.tablets) {
+		zwp_tablet_v2_destroy(*tab);
+	}
+	zwp_tablet_seat_v2_destroy(seat->tablet.wl);
+	seat->tablet.wl = NULL;
+}
+static struct nwl_touch_point *find_touch_point(struct nwl_seat *seat, int32_t id) {
+	for (int i = 0; i < NWL_TOUCH_MAX_POINTS; i++) {
+		struct nwl_touch_point *point = &seat->touch_event.points[i];
+		if (point->active && point->id == id) {
+			return point;
+		}
+	}
+	return NULL;
+}
+
 static void handle_touch_down(void *data,
 		struct wl_touch *wl_touch,
 		uint32_t serial,
@@ -614,7 +1667,30 @@ static void handle_touch_down(void *data,
 		int32_t id,
 		wl_fixed_t x,
 		wl_fixed_t y) {
-	// bla
+	UNUSED(wl_touch);
+	if (!surface) {
+		return;
+	}
+	struct nwl_seat *seat = data;
+	seat->touch_serial = serial;
+	for (int i = 0; i < NWL_TOUCH_MAX_POINTS; i++) {
+		struct nwl_touch_point *point = &seat->touch_event.points[i];
+		// A slot that went up this frame is still waiting to be dispatched.
+		if (!point->active && !point->changed) {
+			*point = (struct nwl_touch_point) {
+				.id = id,
+				.active = true,
+				.changed = NWL_TOUCH_POINT_DOWN | NWL_TOUCH_POINT_MOTION,
+				.surface = wl_surface_get_user_data(surface),
+				.serial = serial,
+				.time = time,
+				.surface_x = x,
+				.surface_y = y,
+			};
+			return;
+		}
+	}
+	// More fingers than slots, this one is ignored.
 }
 
 static void handle_touch_up(void *data,
@@ -622,7 +1698,16 @@ static void handle_touch_up(void *data,
 		uint32_t serial,
 		uint32_t time,
 		int32_t id) {
-	// bla
+	UNUSED(wl_touch);
+	struct nwl_seat *seat = data;
+	struct nwl_touch_point *point = find_touch_point(seat, id);
+	if (!point) {
+		return;
+	}
+	point->active = false;
+	point->changed |= NWL_TOUCH_POINT_UP;
+	point->serial = serial;
+	point->time = time;
 }
 
 static void handle_touch_motion(void *data,
@@ -631,17 +1716,71 @@ static void handle_touch_motion(void *data,
 		int32_t id,
 		wl_fixed_t x,
 		wl_fixed_t y) {
-	// bla
+	UNUSED(wl_touch);
+	struct nwl_seat *seat = data;
+	struct nwl_touch_point *point = find_touch_point(seat, id);
+	if (!point) {
+		return;
+	}
+	point->changed |= NWL_TOUCH_POINT_MOTION;
+	point->time = time;
+	point->surface_x = x;
+	point->surface_y = y;
+}
+
+// Every surface with a changed point gets a single call with the whole array.
+static void dispatch_touch_event(struct nwl_seat *seat) {
+	struct nwl_surface *dispatched[NWL_TOUCH_MAX_POINTS];
+	int num_dispatched = 0;
+	for (int i = 0; i < NWL_TOUCH_MAX_POINTS; i++) {
+		struct nwl_touch_point *point = &seat->touch_event.points[i];
+		if (!point->changed || !point->surface) {
+			continue;
+		}
+		int j;
+		for (j = 0; j < num_dispatched; j++) {
+			if (dispatched[j] == point->surface) {
+				break;
+			}
+		}
+		if (j < num_dispatched) {
+			continue;
+		}
+		dispatched[num_dispatched++] = point->surface;
+		if (point->surface->impl.input_touch) {
+			point->surface->impl.input_touch(point->surface, seat, &seat->touch_event);
+		}
+	}
+	for (int i = 0; i < NWL_TOUCH_MAX_POINTS; i++) {
+		struct nwl_touch_point *point = &seat->touch_event.points[i];
+		if (!point->active) {
+			*point = (struct nwl_touch_point){0};
+		}
+		point->changed = 0;
+	}
+	seat->touch_event.cancelled = false;
 }
 
 static void handle_touch_frame(void *data,
 		struct wl_touch *wl_touch) {
-	// bla
+	UNUSED(wl_touch);
+	dispatch_touch_event(data);
 }
 
 static void handle_touch_cancel(void *data,
 		struct wl_touch *wl_touch) {
-	// bla
+	UNUSED(wl_touch);
+	struct nwl_seat *seat = data;
+	// The compositor took over, every point is gone.
+	seat->touch_event.cancelled = true;
+	for (int i = 0; i < NWL_TOUCH_MAX_POINTS; i++) {
+		struct nwl_touch_point *point = &seat->touch_event.points[i];
+		if (point->active) {
+			point->active = false;
+			point->changed |= NWL_TOUCH_POINT_UP;
+		}
+	}
+	dispatch_touch_event(seat);
 }
 
 static void handle_touch_shape(void *data,
@@ -649,14 +1788,29 @@ static void handle_touch_shape(void *data,
 		int32_t id,
 		wl_fixed_t major,
 		wl_fixed_t minor) {
-	// bla
+	UNUSED(wl_touch);
+	struct nwl_seat *seat = data;
+	struct nwl_touch_point *point = find_touch_point(seat, id);
+	if (!point) {
+		return;
+	}
+	point->changed |= NWL_TOUCH_POINT_SHAPE;
+	point->major = major;
+	point->minor = minor;
 }
 
 static void handle_touch_orientation(void *data,
 		struct wl_touch *wl_touch,
 		int32_t id,
 		wl_fixed_t orientation) {
-	// bla
+	UNUSED(wl_touch);
+	struct nwl_seat *seat = data;
+	struct nwl_touch_point *point = find_touch_point(seat, id);
+	if (!point) {
+		return;
+	}
+	point->changed |= NWL_TOUCH_POINT_ORIENTATION;
+	point->orientation = orientation;
 }
 
 static const struct wl_touch_listener touch_listener = {
@@ -668,19 +1822,25 @@ static const struct wl_touch_listener touch_listener = {
 	handle_touch_shape,
 	handle_touch_orientation
 };
-*/
 
 static void seat_release_keyboard(struct nwl_seat *seat) {
+	if (seat->keyboard_keymap_job) {
+		keymap_job_cancel(seat);
+	}
 	wl_keyboard_release(seat->keyboard);
 	unref_seat_xkb(seat);
+	seat->keybind_keys.size = 0;
 	seat->keyboard = NULL;
 }
 
 static void seat_release_pointer(struct nwl_seat *seat) {
 	wl_pointer_release(seat->pointer);
+	stop_xcursor_animation(seat);
+	seat->pointer_surface.xcursor = NULL;
 	if (seat->pointer_surface.xcursor_surface) {
 		wl_surface_destroy(seat->pointer_surface.xcursor_surface);
 		seat->pointer_surface.xcursor_surface = NULL;
+		seat->pointer_surface.xcursor_scale = 0;
 	}
 	if (seat->pointer_surface.shape_device) {
 		wp_cursor_shape_device_v1_destroy(seat->pointer_surface.shape_device);
@@ -696,6 +1856,9 @@ static void handle_seat_capabilities(void *data, struct wl_seat *seat, uint32_t
 			nwseat->keyboard = wl_seat_get_keyboard(seat);
 			nwseat->keyboard_event = (struct nwl_keyboard_event){ 0 };
 			wl_keyboard_add_listener(nwseat->keyboard, &keyboard_listener, data);
+			if (nwseat->keyboard_compose_enabled) {
+				compose_table_prewarm(nwseat->core);
+			}
 		}
 	} else if (nwseat->keyboard) {
 		seat_release_keyboard(nwseat);
@@ -709,12 +1872,16 @@ static void handle_seat_capabilities(void *data, struct wl_seat *seat, uint32_t
 	} else if (nwseat->pointer) {
 		seat_release_pointer(nwseat);
 	}
-	/*
 	if (capabilities & WL_SEAT_CAPABILITY_TOUCH) {
-		nwseat->touch = wl_seat_get_touch(seat);
-		wl_touch_add_listener(nwseat->touch, &touch_listener, data);
+		if (!nwseat->touch) {
+			nwseat->touch = wl_seat_get_touch(seat);
+			nwseat->touch_event = (struct nwl_touch_event){ 0 };
+			wl_touch_add_listener(nwseat->touch, &touch_listener, data);
+		}
+	} else if (nwseat->touch) {
+		wl_touch_release(nwseat->touch);
+		nwseat->touch = NULL;
 	}
-	*/
 }
 
 static void handle_seat_name(void *data, struct wl_seat *seat, const char *name) {
@@ -733,8 +1900,16 @@ static void handle_data_offer_offer(void *data, struct wl_data_offer *wl_data_of
 	if (seat->data_device.incoming.offer != wl_data_offer) {
 		return; // eek!
 	}
-	char **dest = wl_array_add(&seat->data_device.incoming.mime, sizeof(char*));
-	*dest = strdup(mime_type);
+	struct nwl_data_offer *offer = &seat->data_device.incoming;
+	uint32_t atom = nwl_mime_atom(seat->core, mime_type);
+	if (nwl_data_offer_has_mime(offer, atom)) {
+		return;
+	}
+	uint32_t *dest = wl_array_add(&offer->mime_atoms, sizeof(uint32_t));
+	*dest = atom;
+	if (atom < NWL_MIME_SET_BITS) {
+		offer->mime_set[atom / 64] |= 1ull << (atom % 64);
+	}
 }
 
 static void handle_data_offer_source_actions(void *data, struct wl_data_offer *wl_data_offer,
@@ -771,20 +1946,18 @@ static void data_device_offer(void *data, struct wl_data_device *wl_data_device,
 	}
 	seat->data_device.incoming.offer = id;
 	wl_data_offer_add_listener(id, &data_offer_listener, seat);
-	wl_array_init(&seat->data_device.incoming.mime);
 }
 
+// Swapping keeps the atom arrays around, so a busy clipboard doesn't keep allocating.
 static inline void move_offer(struct nwl_data_offer *dest, struct nwl_data_offer *src) {
-	memcpy(dest, src, sizeof(struct nwl_data_offer));
-	memset(src, 0, sizeof(struct nwl_data_offer));
+	struct nwl_data_offer tmp = *dest;
+	*dest = *src;
+	*src = tmp;
 }
 
 static inline void destroy_offer(struct nwl_data_offer *offer) {
-	char **mimetype;
-	wl_array_for_each(mimetype, &offer->mime) {
-		free(*mimetype);
-	}
-	wl_array_release(&offer->mime);
+	offer->mime_atoms.size = 0;
+	memset(offer->mime_set, 0, sizeof(offer->mime_set));
 	wl_data_offer_destroy(offer->offer);
 	offer->offer = 0;
 }
@@ -890,6 +2063,28 @@ void nwl_seat_clear_focus(struct nwl_surface *surface) {
 		if (seat->keyboard_focus == surface) {
 			seat->keyboard_focus = NULL;
 		}
+		for (int i = 0; i < NWL_TOUCH_MAX_POINTS; i++) {
+			if (seat->touch_event.points[i].surface == surface) {
+				seat->touch_event.points[i] = (struct nwl_touch_point){0};
+			}
+		}
+		struct nwl_tablet_tool *tool;
+		wl_list_for_each(tool, &seat->tablet.tools, link) {
+			if (tool->focus == surface) {
+				tool->focus = NULL;
+			}
+		}
+		if (seat->tablet.pending_focus == surface) {
+			seat->tablet.samples.size = 0;
+			seat->tablet.pending_focus = NULL;
+		}
+		struct nwl_pointer_history *history = &seat->pointer_history;
+		for (uint32_t i = 0; i < history->count; i++) {
+			struct nwl_pointer_sample *sample = &history->samples[(history->head + i) & (history->capacity - 1)];
+			if (sample->surface == surface) {
+				sample->surface = NULL;
+			}
+		}
 	}
 }
 
@@ -901,9 +2096,18 @@ void nwl_seat_deinit(struct nwl_seat *seat) {
 	if (seat->keyboard) {
 		seat_release_keyboard(seat);
 	}
+	if (seat->touch) {
+		wl_touch_release(seat->touch);
+	}
 	if (seat->name) {
 		free(seat->name);
 	}
+	free(seat->pointer_history.samples);
+	if (seat->tablet.wl) {
+		seat_release_tablet(seat);
+	}
+	wl_array_release(&seat->tablet.tablets);
+	wl_array_release(&seat->tablet.samples);
 	if (seat->data_device.wl) {
 		if (seat->data_device.drop.offer) {
 			destroy_offer(&seat->data_device.drop);
@@ -916,6 +2120,13 @@ void nwl_seat_deinit(struct nwl_seat *seat) {
 		}
 		wl_data_device_release(seat->data_device.wl);
 	}
+	wl_array_release(&seat->data_device.drop.mime_atoms);
+	wl_array_release(&seat->data_device.incoming.mime_atoms);
+	wl_array_release(&seat->data_device.selection.mime_atoms);
+	close(seat->keyboard_keymap_fd);
+	close(seat->pointer_surface.xcursor_fd);
+	wl_array_release(&seat->keyboard_repeat_text);
+	wl_array_release(&seat->keybind_keys);
 	wl_seat_release(seat->wl_seat);
 }
 
@@ -930,12 +2141,23 @@ void nwl_seat_init(struct nwl_seat *nwlseat, struct wl_seat *wlseat, struct nwl_
 	nwlseat->core = core;
 	nwlseat->wl_seat = wlseat;
 	nwlseat->keyboard_repeat_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	nwlseat->keyboard_keymap_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	nwlseat->keyboard_keymap_async = false;
+	nwlseat->pointer_surface.xcursor_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	wl_array_init(&nwlseat->keyboard_repeat_text);
+	wl_array_init(&nwlseat->keybind_keys);
+	wl_list_init(&nwlseat->tablet.tools);
+	wl_array_init(&nwlseat->tablet.tablets);
+	wl_array_init(&nwlseat->tablet.samples);
 
 	wl_list_insert(&core->seats, &nwlseat->link);
 	wl_seat_add_listener(wlseat, &seat_listener, nwlseat);
 	if (core->wl.data_device_manager) {
 		nwl_seat_add_data_device(nwlseat);
 	}
+	if (core->wl.tablet_manager) {
+		nwl_seat_add_tablet_seat(nwlseat);
+	}
 
 }
 
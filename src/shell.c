@@ -4,6 +4,10 @@
 #include "nwl/nwl.h"
 #include "nwl/surface.h"
 
+// Is in surface.c
+void *surface_queue_wrap(struct nwl_surface *surface, void *factory);
+void surface_queue_unwrap(struct nwl_surface *surface, void *wrapper);
+
 static void handle_layer_configure(void *data, struct zwlr_layer_surface_v1 *layer, uint32_t serial, uint32_t width, uint32_t height) {
 	UNUSED(layer);
 	struct nwl_surface *surf = (struct nwl_surface*)data;
@@ -198,8 +202,10 @@ bool nwl_surface_role_layershell(struct nwl_surface *surface, struct wl_output *
 	if (!surface->core->wl.layer_shell || surface->role_id) {
 		return false;
 	}
-	surface->role.layer.wl = zwlr_layer_shell_v1_get_layer_surface(surface->core->wl.layer_shell,
+	struct zwlr_layer_shell_v1 *layer_shell = surface_queue_wrap(surface, surface->core->wl.layer_shell);
+	surface->role.layer.wl = zwlr_layer_shell_v1_get_layer_surface(layer_shell,
 			surface->wl.surface, output, layer, surface->title);
+	surface_queue_unwrap(surface, layer_shell);
 	zwlr_layer_surface_v1_add_listener(surface->role.layer.wl, &layer_listener, surface);
 	surface->role_id = NWL_SURFACE_ROLE_LAYER;
 	surface->core->num_surfaces++;
@@ -211,7 +217,10 @@ bool nwl_surface_role_toplevel(struct nwl_surface *surface) {
 	if (!surface->core->wl.xdg_wm_base || surface->role_id) {
 		return false;
 	}
-	surface->wl.xdg_surface = xdg_wm_base_get_xdg_surface(surface->core->wl.xdg_wm_base, surface->wl.surface);
+	// The toplevel inherits the xdg_surface's queue.
+	struct xdg_wm_base *wm_base = surface_queue_wrap(surface, surface->core->wl.xdg_wm_base);
+	surface->wl.xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, surface->wl.surface);
+	surface_queue_unwrap(surface, wm_base);
 	surface->role.toplevel.wl = xdg_surface_get_toplevel(surface->wl.xdg_surface);
 	surface->role.toplevel.wm_capabilities = 255;
 	xdg_toplevel_add_listener(surface->role.toplevel.wl, &toplevel_listener, surface);
@@ -220,8 +229,10 @@ bool nwl_surface_role_toplevel(struct nwl_surface *surface) {
 		xdg_toplevel_set_title(surface->role.toplevel.wl, surface->title);
 	}
 	if (surface->core->wl.decoration) {
-		surface->role.toplevel.decoration = zxdg_decoration_manager_v1_get_toplevel_decoration(surface->core->wl.decoration,
+		struct zxdg_decoration_manager_v1 *decoration = surface_queue_wrap(surface, surface->core->wl.decoration);
+		surface->role.toplevel.decoration = zxdg_decoration_manager_v1_get_toplevel_decoration(decoration,
 			surface->role.toplevel.wl);
+		surface_queue_unwrap(surface, decoration);
 		zxdg_toplevel_decoration_v1_add_listener(surface->role.toplevel.decoration, &decoration_listener, surface);
 	} else {
 		surface->role.toplevel.decoration = NULL;
@@ -241,9 +252,12 @@ bool nwl_surface_role_popup(struct nwl_surface *surface, struct nwl_surface *par
 			!parent->wl.xdg_surface && parent->role_id != NWL_SURFACE_ROLE_LAYER)) {
 		return false;
 	}
-	surface->wl.xdg_surface = xdg_wm_base_get_xdg_surface(surface->core->wl.xdg_wm_base, surface->wl.surface);
+	struct xdg_wm_base *wm_base = surface_queue_wrap(surface, surface->core->wl.xdg_wm_base);
+	surface->wl.xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, surface->wl.surface);
+	surface_queue_unwrap(surface, wm_base);
 	struct xdg_surface *xdg_parent = parent ? parent->wl.xdg_surface : NULL;
 	surface->role.popup.wl = xdg_surface_get_popup(surface->wl.xdg_surface, xdg_parent, positioner);
+	surface->role.popup.parent = parent;
 	if (parent && !xdg_parent) {
 		zwlr_layer_surface_v1_get_popup(parent->role.layer.wl, surface->role.popup.wl);
 	}
@@ -52,6 +52,11 @@ static void handle_buffer_release(void *data, struct wl_buffer *buffer) {
 		return;
 	}
 	struct nwl_shm_buffer *nwlbuf = data;
+	if (nwlbuf->acquired > 1) {
+		nwlbuf->acquired--;
+		return;
+	}
+	nwlbuf->acquired = 0;
 	nwlbuf->flags &= ~NWL_SHM_BUFFER_ACQUIRED;
 }
 
@@ -63,7 +68,23 @@ static void destroy_buffer(int buf_idx, struct nwl_shm_bufferman *bufferman) {
 	if (bufferman->impl) {
 		bufferman->impl->buffer_destroy(buf_idx, bufferman);
 	}
-	wl_buffer_destroy(bufferman->buffers[buf_idx].wl_buffer);
+	struct nwl_shm_buffer *buf = &bufferman->buffers[buf_idx];
+	wl_buffer_destroy(buf->wl_buffer);
+	for (int i = 0; i < NWL_SHM_BUFFER_MAX_VIEWS - 1; i++) {
+		if (buf->views[i]) {
+			wl_buffer_destroy(buf->views[i]);
+			buf->views[i] = NULL;
+		}
+	}
+}
+
+static struct wl_buffer *create_wl_buffer(struct nwl_shm_bufferman *bm, struct nwl_shm_buffer *buf, int32_t offset) {
+	struct wl_buffer *wl_buffer = wl_shm_pool_create_buffer(bm->pool.pool, offset, bm->width, bm->height, bm->stride, bm->format);
+	if (bm->queue) {
+		wl_proxy_set_queue((struct wl_proxy*)wl_buffer, bm->queue);
+	}
+	wl_buffer_add_listener(wl_buffer, &buffer_listener, buf);
+	return wl_buffer;
 }
 
 static bool try_check_buffer(struct nwl_shm_bufferman *bm, int buf_idx) {
@@ -78,10 +99,10 @@ static bool try_check_buffer(struct nwl_shm_bufferman *bm, int buf_idx) {
 		}
 	}
 	int32_t offset = (bm->pool.size/bm->num_slots) * buf_idx;
-	buf->wl_buffer = wl_shm_pool_create_buffer(bm->pool.pool, offset, bm->width, bm->height, bm->stride, bm->format);
+	buf->wl_buffer = create_wl_buffer(bm, buf, offset);
 	buf->flags = 0;
+	buf->acquired = 0;
 	buf->bufferdata = bm->pool.data+offset; // Ugh..
-	wl_buffer_add_listener(buf->wl_buffer, &buffer_listener, buf);
 	if (bm->impl) {
 		bm->impl->buffer_create(buf_idx, bm);
 	}
@@ -97,6 +118,21 @@ int nwl_shm_bufferman_get_next(struct nwl_shm_bufferman *bufferman) {
 	return -1;
 }
 
+struct wl_buffer *nwl_shm_bufferman_get_view(struct nwl_shm_bufferman *bufferman, int buffer_idx, unsigned int view) {
+	struct nwl_shm_buffer *buf = &bufferman->buffers[buffer_idx];
+	if (view == 0) {
+		return buf->wl_buffer;
+	}
+	if (view >= NWL_SHM_BUFFER_MAX_VIEWS) {
+		return NULL;
+	}
+	// Same memory, but every surface gets its own wl_buffer so each release is its own event.
+	if (!buf->views[view - 1]) {
+		buf->views[view - 1] = create_wl_buffer(bufferman, buf, buf->bufferdata - bufferman->pool.data);
+	}
+	return buf->views[view - 1];
+}
+
 void nwl_shm_bufferman_set_slots(struct nwl_shm_bufferman *bufferman, struct wl_shm *wl_shm, uint8_t num_slots) {
 	num_slots = num_slots < 1 ? 1 :
 		(num_slots > NWL_SHM_BUFFERMAN_MAX_BUFFERS ? NWL_SHM_BUFFERMAN_MAX_BUFFERS : num_slots);
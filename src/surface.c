@@ -14,9 +14,18 @@
 
 // Is in wayland.c
 void surface_mark_dirty(struct nwl_surface *surface);
+void surface_unmark_dirty(struct nwl_surface *surface);
+void startup_trace_finish(struct nwl_core *core);
 
 struct wl_callback_listener callback_listener;
 
+// Both nwl_core_handle_dirt and nwl_surface_handle_dirt go by this.
+// A surface waiting for its configure is updated from the configure handler instead.
+bool surface_wants_update(struct nwl_surface *surface) {
+	return surface->states & NWL_SURFACE_STATE_NEEDS_UPDATE && !surface->wl.frame_cb &&
+		!(surface->states & NWL_SURFACE_STATE_NEEDS_CONFIGURE);
+}
+
 void nwl_surface_update(struct nwl_surface *surface) {
 	surface->states = surface->states & ~NWL_SURFACE_STATE_NEEDS_UPDATE;
 	surface->impl.update(surface);
@@ -28,7 +37,8 @@ static void cb_done(void *data, struct wl_callback *cb, uint32_t cb_data) {
 	surf->wl.frame_cb = NULL;
 	wl_callback_destroy(cb);
 	if (surf->states & NWL_SURFACE_STATE_NEEDS_UPDATE) {
-		nwl_surface_update(surf);
+		// Don't update right away, input events later in the same dispatch should make it into this frame.
+		surface_mark_dirty(surf);
 	}
 }
 
@@ -110,6 +120,12 @@ static void handle_preferred_scale(void *data, struct wl_surface *surface, int32
 	UNUSED(surface);
 	struct nwl_surface *surf = data;
 	surf->scale_preferred = factor;
+#if NWL_HAS_SEAT
+	// Output scales are prewarmed already, fractional setups can ask for others.
+	if (!surf->core->wl.cursor_shape_manager && !wl_list_empty(&surf->core->seats)) {
+		nwl_cursor_theme_prewarm(surf->core, factor);
+	}
+#endif
 	if (!(surf->flags & NWL_SURFACE_FLAG_NO_AUTOSCALE)) {
 		surface_autoscale(surf);
 	}
@@ -129,10 +145,31 @@ static const struct wl_surface_listener surface_listener = {
 	handle_preferred_transform
 };
 
+// Objects for a queued surface must be created on its queue, not moved there after. Its thread
+// may already be reading the display, and could miss the first configure otherwise.
+// Create them from the wrapper this returns, then hand it to surface_queue_unwrap.
+void *surface_queue_wrap(struct nwl_surface *surface, void *factory) {
+	if (!surface->queue) {
+		return factory;
+	}
+	void *wrapper = wl_proxy_create_wrapper(factory);
+	wl_proxy_set_queue(wrapper, surface->queue);
+	return wrapper;
+}
+
+void surface_queue_unwrap(struct nwl_surface *surface, void *wrapper) {
+	if (surface->queue) {
+		wl_proxy_wrapper_destroy(wrapper);
+	}
+}
+
 void nwl_surface_init(struct nwl_surface *surface, struct nwl_core *core, const char *title) {
 	surface->core = core;
+	surface->queue = NULL;
 	surface->frame = 0;
 	surface->defer_update = false;
+	surface->priority = NWL_SURFACE_PRIORITY_VISIBLE;
+	surface->deferrals = 0;
 	surface->wl.surface = NULL;
 	surface->wl.xdg_surface = NULL;
 	surface->wl.frame_cb = NULL;
@@ -200,10 +237,14 @@ void nwl_surface_destroy(struct nwl_surface *surface) {
 	// clear any focuses
 	nwl_seat_clear_focus(surface);
 #endif
-	if (!wl_list_empty(&surface->dirtlink)) {
-		wl_list_remove(&surface->dirtlink);
-	}
+	surface_unmark_dirty(surface);
 	wl_list_remove(&surface->link);
+	struct nwl_surface *popup;
+	wl_list_for_each(popup, &surface->core->surfaces, link) {
+		if (popup->role_id == NWL_SURFACE_ROLE_POPUP && popup->role.popup.parent == surface) {
+			popup->role.popup.parent = NULL;
+		}
+	}
 
 	if (surface->outputs.outputs) {
 		free(surface->outputs.outputs);
@@ -288,7 +329,9 @@ void nwl_surface_request_callback(struct nwl_surface *surface) {
 }
 
 void nwl_surface_buffer_submitted(struct nwl_surface *surface) {
-	surface->frame++;
+	if (surface->frame++ == 0) {
+		startup_trace_finish(surface->core);
+	}
 	nwl_surface_request_callback(surface);
 	if (surface->configure_serial) {
 		nwl_surface_ack_configure(surface);
@@ -315,7 +358,9 @@ void nwl_surface_role_unset(struct nwl_surface *surface) {
 	nwl_surface_destroy_role(surface);
 	surface->states = 0;
 	memset(&surface->wl, 0, sizeof(surface->wl));
-	surface->wl.surface = wl_compositor_create_surface(surface->core->wl.compositor);
+	struct wl_compositor *compositor = surface_queue_wrap(surface, surface->core->wl.compositor);
+	surface->wl.surface = wl_compositor_create_surface(compositor);
+	surface_queue_unwrap(surface, compositor);
 	wl_surface_set_user_data(surface->wl.surface, surface);
 	wl_surface_add_listener(surface->wl.surface, &surface_listener, surface);
 	surface->role_id = 0;
@@ -327,6 +372,27 @@ void nwl_surface_role_unset(struct nwl_surface *surface) {
 	}
 }
 
+bool nwl_surface_set_queue(struct nwl_surface *surface, struct wl_event_queue *queue) {
+	// Role objects would be left behind on the old queue.
+	if (surface->role_id) {
+		return false;
+	}
+	surface->queue = queue;
+	wl_proxy_set_queue((struct wl_proxy*)surface->wl.surface, queue);
+	if (surface->wl.frame_cb) {
+		wl_proxy_set_queue((struct wl_proxy*)surface->wl.frame_cb, queue);
+	}
+	return true;
+}
+
+void nwl_surface_handle_dirt(struct nwl_surface *surface) {
+	if (surface->states & NWL_SURFACE_STATE_DESTROY) {
+		nwl_surface_destroy(surface);
+	} else if (surface_wants_update(surface)) {
+		nwl_surface_update(surface);
+	}
+}
+
 bool nwl_surface_role_subsurface(struct nwl_surface *surface, struct nwl_surface *parent) {
 	if (surface->role_id) {
 		return false;
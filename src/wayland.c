@@ -2,11 +2,14 @@
 #include <wayland-client-core.h>
 #include <wayland-cursor.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <unistd.h>
 #include "nwl/nwl.h"
 #include "nwl/surface.h"
@@ -18,12 +21,27 @@
 #if NWL_HAS_SEAT
 #include "nwl/seat.h"
 #include "cursor-shape-v1.h"
+#include "tablet-unstable-v2.h"
 #endif
 
 // in seat.c
 void nwl_seat_add_data_device(struct nwl_seat *seat);
+void nwl_seat_add_tablet_seat(struct nwl_seat *seat);
 // in shm.c
 void nwl_shm_add_listener(struct nwl_core *core);
+// in surface.c
+bool surface_wants_update(struct nwl_surface *surface);
+// further down
+void startup_trace_begin(struct nwl_core *core, const struct timespec *start);
+#if NWL_HAS_IO_URING
+// in poll_uring.c
+bool nwl_uring_init(struct nwl_poll *poll);
+void nwl_uring_destroy(struct nwl_poll *poll);
+void nwl_uring_add(struct nwl_poll *poll, struct nwl_poll_data *data);
+void nwl_uring_mod(struct nwl_poll *poll, struct nwl_poll_data *data);
+void nwl_uring_del(struct nwl_poll *poll, struct nwl_poll_data *data);
+int nwl_uring_wait(struct nwl_poll *poll, int timeout);
+#endif
 
 static void handle_wm_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial) {
 	UNUSED(data);
@@ -71,15 +89,20 @@ static void handle_output_mode(void *data,
 	UNUSED(height);
 	UNUSED(refresh);
 }
+static void output_done(struct nwl_output *output) {
+	if (output->is_done > 0) {
+		output->is_done--;
+		if (output->is_done == 0 && output->done) {
+			output->done(output);
+		}
+	}
+}
+
 static void handle_output_done(
 		void *data,
 		struct wl_output *wl_output) {
 	UNUSED(wl_output);
-	struct nwl_output *nwloutput = data;
-	if (nwloutput->is_done > 0) {
-		nwloutput->is_done--;
-		// Notify somehow?
-	}
+	output_done(data);
 }
 
 static void handle_output_scale(
@@ -135,9 +158,10 @@ static void handle_xdg_output_logical_size(void *data, struct zxdg_output_v1 *ou
 }
 
 static void handle_xdg_output_done(void *data, struct zxdg_output_v1 *output) {
-	// shouldn't be used
-	UNUSED(data);
-	UNUSED(output);
+	// Deprecated since version 3, wl_output.done is sent instead. Only counted below that.
+	if (zxdg_output_v1_get_version(output) < 3) {
+		output_done(data);
+	}
 }
 
 static void handle_xdg_output_name(void *data, struct zxdg_output_v1 *output, const char *name) {
@@ -180,6 +204,14 @@ void nwl_output_deinit(struct nwl_output *output) {
 	wl_output_destroy(output->output);
 }
 
+static void output_get_xdg_output(struct nwl_output *output) {
+	output->xdg_output = zxdg_output_manager_v1_get_xdg_output(output->core->wl.xdg_output_manager, output->output);
+	zxdg_output_v1_add_listener(output->xdg_output, &xdg_output_listener, output);
+	if (zxdg_output_v1_get_version(output->xdg_output) < 3) {
+		output->is_done++;
+	}
+}
+
 void nwl_output_init(struct nwl_output *output, struct nwl_core *core, struct wl_output *wl_output) {
 	wl_output_add_listener(wl_output, &output_listener, output);
 	wl_output_set_user_data(wl_output, output);
@@ -189,11 +221,10 @@ void nwl_output_init(struct nwl_output *output, struct nwl_core *core, struct wl
 	output->name = NULL;
 	output->description = NULL;
 	output->xdg_output = NULL;
+	output->done = NULL;
 	wl_list_insert(&core->outputs, &output->link);
 	if (core->wl.xdg_output_manager) {
-		output->is_done = 2;
-		output->xdg_output = zxdg_output_manager_v1_get_xdg_output(core->wl.xdg_output_manager, wl_output);
-		zxdg_output_v1_add_listener(output->xdg_output, &xdg_output_listener, output);
+		output_get_xdg_output(output);
 	}
 }
 
@@ -227,15 +258,39 @@ bool nwl_core_handle_global(struct nwl_core *core, struct wl_registry *registry,
 		return true;
 	} else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
 		core->wl.xdg_output_manager = nwl_registry_bind(registry, name, &zxdg_output_manager_v1_interface, version, 3);
+		// Ask for xdg_outputs in case wl_output globals were sent before it.
+		struct nwl_output *nwloutput;
+		wl_list_for_each(nwloutput, &core->outputs, link) {
+			if (nwloutput->xdg_output) {
+				continue;
+			}
+			output_get_xdg_output(nwloutput);
+		}
 		return true;
 	}
 #if NWL_HAS_SEAT
 	else if (strcmp(interface, wl_data_device_manager_interface.name) == 0) {
 		core->wl.data_device_manager = nwl_registry_bind(registry, name, &wl_data_device_manager_interface, version, 3);
+		// Same thing for seats
+		struct nwl_seat *seat;
+		wl_list_for_each(seat, &core->seats, link) {
+			if (!seat->data_device.wl) {
+				nwl_seat_add_data_device(seat);
+			}
+		}
 		return true;
 	} else if (strcmp(interface, wp_cursor_shape_manager_v1_interface.name) == 0) {
 		core->wl.cursor_shape_manager = nwl_registry_bind(registry, name, &wp_cursor_shape_manager_v1_interface, version, 2);
 		return true;
+	} else if (strcmp(interface, zwp_tablet_manager_v2_interface.name) == 0) {
+		core->wl.tablet_manager = nwl_registry_bind(registry, name, &zwp_tablet_manager_v2_interface, version, 1);
+		struct nwl_seat *seat;
+		wl_list_for_each(seat, &core->seats, link) {
+			if (!seat->tablet.wl) {
+				nwl_seat_add_tablet_seat(seat);
+			}
+		}
+		return true;
 	}
 #endif
 	return false;
@@ -244,13 +299,69 @@ bool nwl_core_handle_global(struct nwl_core *core, struct wl_registry *registry,
 struct nwl_easy_output {
 	struct nwl_output output;
 	struct nwl_easy_global global;
+	struct wl_callback *sync_cb; // Stands in for wl_output.done on version 1
 	bool announced;
 };
 
+static void announce_output(struct nwl_easy *easy, struct nwl_easy_output *output) {
+	if (output->announced) {
+		return;
+	}
+	output->announced = true;
+	if (easy->events.global_bound != NULL) {
+		struct nwl_bound_global glob = {
+			.global.output = &output->output,
+			.kind = NWL_BOUND_GLOBAL_OUTPUT,
+		};
+		easy->events.global_bound(&glob);
+	}
+}
+
+static void easy_prewarm_cursor(struct nwl_easy *easy, int32_t scale) {
+#if NWL_HAS_SEAT
+	// No need for xcursor themes with cursor shapes!
+	if (easy->core.wl.cursor_shape_manager || wl_list_empty(&easy->core.seats)) {
+		return;
+	}
+	// Loads in the background, so the pointer entering this output doesn't have to.
+	nwl_cursor_theme_prewarm(&easy->core, scale);
+#else
+	UNUSED(easy);
+	UNUSED(scale);
+#endif
+}
+
+static void easy_output_done(struct nwl_output *output) {
+	struct nwl_easy_output *easyoutput = wl_container_of(output, easyoutput, output);
+	struct nwl_easy *easy = wl_container_of(output->core, easy, core);
+	// Synchronous startup keeps announcing from announce_outputs, after nwl_easy_init's
+	// roundtrips and not in the middle of them.
+	if (easy->async_startup) {
+		announce_output(easy, easyoutput);
+	}
+	easy_prewarm_cursor(easy, output->scale);
+}
+
+
+static void handle_output_sync_done(void *data, struct wl_callback *cb, uint32_t cb_data) {
+	UNUSED(cb_data);
+	struct nwl_easy_output *output = data;
+	wl_callback_destroy(cb);
+	output->sync_cb = NULL;
+	// Everything bind sent has arrived by now, which is as done as a version 1 output gets.
+	output_done(&output->output);
+}
+
+static const struct wl_callback_listener output_sync_listener = {
+	handle_output_sync_done
+};
 
 static void nwl_easy_output_destroy(struct nwl_easy_global *global) {
 	struct nwl_easy_output *output = wl_container_of(global, output, global);
 	struct nwl_easy *easy = wl_container_of(output->output.core, easy, core);
+	if (output->sync_cb) {
+		wl_callback_destroy(output->sync_cb);
+	}
 	if (easy->events.global_destroy) {
 		struct nwl_bound_global global = { .global.output = &output->output, .kind = NWL_BOUND_GLOBAL_OUTPUT };
 		easy->events.global_destroy(&global);
@@ -274,6 +385,8 @@ static void easy_seat_destroy(struct nwl_easy_global *global) {
 		easy->events.global_destroy(&global);
 	}
 	nwl_easy_del_fd(easy, seat->seat.keyboard_repeat_fd);
+	nwl_easy_del_fd(easy, seat->seat.keyboard_keymap_fd);
+	nwl_easy_del_fd(easy, seat->seat.pointer_surface.xcursor_fd);
 	nwl_seat_deinit(&seat->seat);
 	free(seat);
 }
@@ -283,6 +396,18 @@ static void easy_handle_repeat(struct nwl_easy *easy, uint32_t events, void *dat
 	struct nwl_seat *seat = data;
 	nwl_seat_handle_repeat(seat);
 }
+static void easy_handle_keymap(struct nwl_easy *easy, uint32_t events, void *data) {
+	UNUSED(easy);
+	UNUSED(events);
+	struct nwl_seat *seat = data;
+	nwl_seat_handle_keymap(seat);
+}
+static void easy_handle_xcursor(struct nwl_easy *easy, uint32_t events, void *data) {
+	UNUSED(easy);
+	UNUSED(events);
+	struct nwl_seat *seat = data;
+	nwl_seat_handle_xcursor(seat);
+}
 #endif
 
 static void handle_global_add(void *data, struct wl_registry *reg,
@@ -299,10 +424,16 @@ static void handle_global_add(void *data, struct wl_registry *reg,
 		struct wl_output *wl_output = nwl_registry_bind(reg, name, &wl_output_interface, version, 4);
 		struct nwl_easy_output *output = calloc(1, sizeof(struct nwl_easy_output));
 		nwl_output_init(&output->output, &easy->core, wl_output);
+		output->output.done = easy_output_done;
 		output->global.name = name;
 		output->global.impl.destroy = nwl_easy_output_destroy;
 		wl_list_insert(&easy->globals, &output->global.link);
 		easy->has_new_outputs = true;
+		if (wl_output_get_version(wl_output) < 2) {
+			// No done event before version 2, a sync after the bind has to do.
+			output->sync_cb = wl_display_sync(easy->display);
+			wl_callback_add_listener(output->sync_cb, &output_sync_listener, output);
+		}
 	}
 #if NWL_HAS_SEAT
 	else if (strcmp(interface, wl_seat_interface.name) == 0) {
@@ -312,13 +443,16 @@ static void handle_global_add(void *data, struct wl_registry *reg,
 		wl_list_insert(&easy->globals, &seat->global.link);
 		struct wl_seat *newseat = nwl_registry_bind(reg, name, &wl_seat_interface, version, 8);
 		nwl_seat_init(&seat->seat, newseat, &easy->core);
-		nwl_easy_add_fd(easy, seat->seat.keyboard_repeat_fd, 1, easy_handle_repeat, &seat->seat);
+		nwl_easy_add_fd(easy, seat->seat.keyboard_repeat_fd, EPOLLIN | EPOLLET, easy_handle_repeat, &seat->seat);
+		nwl_easy_set_fd_priority(easy, seat->seat.keyboard_repeat_fd, NWL_POLL_PRIORITY_INPUT);
+		nwl_easy_add_fd(easy, seat->seat.keyboard_keymap_fd, EPOLLIN, easy_handle_keymap, &seat->seat);
+		nwl_easy_set_fd_priority(easy, seat->seat.keyboard_keymap_fd, NWL_POLL_PRIORITY_INPUT);
+		seat->seat.keyboard_keymap_async = true;
+		nwl_easy_add_fd(easy, seat->seat.pointer_surface.xcursor_fd, EPOLLIN, easy_handle_xcursor, &seat->seat);
 		if (easy->events.global_bound) {
 			struct nwl_bound_global global = { .global.seat = &seat->seat, .kind = NWL_BOUND_GLOBAL_SEAT };
 			easy->events.global_bound(&global);
 		}
-	} else if (strcmp(interface, wl_data_device_manager_interface.name) == 0) {
-		easy->core.wl.data_device_manager = nwl_registry_bind(reg, name, &wl_data_device_manager_interface, version, 3);
 	}
 #endif
 }
@@ -352,7 +486,14 @@ void nwl_easy_add_fd(struct nwl_easy *easy, int fd, uint32_t events,
 	wl_list_insert(&easy->poll.data, &polldata->link);
 	polldata->userdata = data;
 	polldata->fd = fd;
+	polldata->events = events;
 	polldata->callback = callback;
+#if NWL_HAS_IO_URING
+	if (easy->poll.ring) {
+		nwl_uring_add(&easy->poll, polldata);
+		return;
+	}
+#endif
 	ep.data.ptr = polldata;
 	ep.events = events;
 	epoll_ctl(easy->poll.epfd, EPOLL_CTL_ADD, fd, &ep);
@@ -360,10 +501,17 @@ void nwl_easy_add_fd(struct nwl_easy *easy, int fd, uint32_t events,
 
 void nwl_easy_del_fd(struct nwl_easy *easy, int fd) {
 	easy->poll.ev = realloc(easy->poll.ev, sizeof(struct epoll_event)* --easy->poll.numfds);
-	epoll_ctl(easy->poll.epfd, EPOLL_CTL_DEL, fd, NULL);
+	if (easy->poll.epfd != -1) {
+		epoll_ctl(easy->poll.epfd, EPOLL_CTL_DEL, fd, NULL);
+	}
 	struct nwl_poll_data *data;
 	wl_list_for_each(data, &easy->poll.data, link) {
 		if (data->fd == fd) {
+#if NWL_HAS_IO_URING
+			if (easy->poll.ring) {
+				nwl_uring_del(&easy->poll, data);
+			}
+#endif
 			wl_list_remove(&data->link);
 			free(data);
 			return;
@@ -371,45 +519,455 @@ void nwl_easy_del_fd(struct nwl_easy *easy, int fd) {
 	}
 }
 
+void nwl_easy_mod_fd(struct nwl_easy *easy, int fd, uint32_t events) {
+	struct nwl_poll_data *data;
+	wl_list_for_each(data, &easy->poll.data, link) {
+		if (data->fd == fd) {
+			data->events = events;
+#if NWL_HAS_IO_URING
+			if (easy->poll.ring) {
+				nwl_uring_mod(&easy->poll, data);
+				return;
+			}
+#endif
+			struct epoll_event ep = {
+				.data.ptr = data,
+				.events = events
+			};
+			epoll_ctl(easy->poll.epfd, EPOLL_CTL_MOD, fd, &ep);
+			return;
+		}
+	}
+}
+
+void nwl_easy_set_fd_priority(struct nwl_easy *easy, int fd, int priority) {
+	struct nwl_poll_data *data;
+	wl_list_for_each(data, &easy->poll.data, link) {
+		if (data->fd == fd) {
+			data->priority = priority;
+			return;
+		}
+	}
+}
+
+static void easy_display_error(struct nwl_easy *easy) {
+	perror("Fatal Wayland error");
+	easy->has_errored = true;
+	easy->core.num_surfaces = 0;
+	easy->run_with_zero_surfaces = false;
+}
+
+static void dispatch_display_pending(struct nwl_easy *easy) {
+	// Dispatch one event at a time so a flood can't starve everything else.
+	easy->display_has_pending = false;
+	for (uint32_t i = 0; i < easy->dispatch_budget; i++) {
+		int ret = wl_display_dispatch_pending_single(easy->display);
+		if (ret == -1) {
+			easy_display_error(easy);
+			return;
+		}
+		if (ret == 0) {
+			return;
+		}
+	}
+	// Out of budget, there might be more left in the queue. Take care of it next time!
+	easy->display_has_pending = true;
+}
+
+static void finish_display_read(struct nwl_easy *easy, bool readable) {
+	if (!easy->display_reading) {
+		return;
+	}
+	easy->display_reading = false;
+	if (!readable) {
+		wl_display_cancel_read(easy->display);
+	} else if (wl_display_read_events(easy->display) == -1) {
+		easy_display_error(easy);
+	}
+}
+
+static void flush_display(struct nwl_easy *easy) {
+	bool congested = wl_display_flush(easy->display) == -1 && errno == EAGAIN;
+	if (congested != easy->core.display_congested) {
+		// Only wait for the socket to become writable while there's something left to write.
+		easy->core.display_congested = congested;
+		nwl_easy_mod_fd(easy, wl_display_get_fd(easy->display), congested ? EPOLLIN | EPOLLOUT : EPOLLIN);
+		if (easy->events.congestion) {
+			easy->events.congestion(easy, congested);
+		}
+	}
+}
+
+static void nwl_wayland_poll_display(struct nwl_easy *easy, uint32_t events, void *data) {
+	UNUSED(data);
+	if (events & EPOLLOUT) {
+		flush_display(easy);
+	}
+	finish_display_read(easy, events & EPOLLIN);
+	if (events & (EPOLLERR | EPOLLHUP) && !(events & EPOLLIN)) {
+		easy_display_error(easy);
+		return;
+	}
+	if (!easy->has_errored) {
+		dispatch_display_pending(easy);
+	}
+}
+
+static struct nwl_surface *root_surface(struct nwl_surface *surface) {
+	while (surface->role_id == NWL_SURFACE_ROLE_SUB) {
+		surface = surface->role.subsurface.parent;
+	}
+	return surface;
+}
+
+static int surface_urgency(struct nwl_surface *surface) {
+	// Every time it's skipped it gets a bit closer to its deadline.
+	int urgency = surface->priority + surface->deferrals;
+	if (urgency > NWL_SURFACE_PRIORITY_FOCUSED) {
+		urgency = NWL_SURFACE_PRIORITY_FOCUSED;
+	}
+#if NWL_HAS_SEAT
+	struct nwl_surface *root = root_surface(surface);
+	struct nwl_seat *seat;
+	wl_list_for_each(seat, &surface->core->seats, link) {
+		if (seat->pointer_focus && root_surface(seat->pointer_focus) == root) {
+			return NWL_SURFACE_PRIORITY_POINTER;
+		}
+		if (seat->keyboard_focus && root_surface(seat->keyboard_focus) == root) {
+			urgency = NWL_SURFACE_PRIORITY_FOCUSED;
+		}
+	}
+#endif
+	return urgency;
+}
+
+// Runs the updates of NWL_SURFACE_FLAG_PARALLEL_UPDATE surfaces side by side.
+// The dispatching thread helps out, and waits for the whole batch before going on.
+struct nwl_update_pool {
+	struct nwl_core_sub sub;
+	pthread_t *threads;
+	uint32_t num_threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	struct nwl_surface **jobs;
+	uint32_t num_jobs;
+	atomic_uint next_job;
+	uint32_t working;
+	uint64_t generation;
+	bool quit;
+	// Guards surfaces_dirty, every dirtlink and has_dirty_surfaces, see dirty_lock.
+	pthread_mutex_t dirty_lock;
+};
+
+static void update_pool_run(struct nwl_update_pool *pool) {
+	unsigned i;
+	while ((i = atomic_fetch_add(&pool->next_job, 1)) < pool->num_jobs) {
+		nwl_surface_update(pool->jobs[i]);
+	}
+}
+
+static void *update_pool_thread(void *data) {
+	struct nwl_update_pool *pool = data;
+	uint64_t seen = 0;
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (pool->generation == seen && !pool->quit) {
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		if (pool->quit) {
+			break;
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+		update_pool_run(pool);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->working == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static void update_pool_sub_destroy(struct nwl_core_sub *sub) {
+	struct nwl_update_pool *pool = wl_container_of(sub, pool, sub);
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	for (uint32_t i = 0; i < pool->num_threads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_mutex_destroy(&pool->dirty_lock);
+	free(pool->threads);
+	free(pool);
+}
+
+static const struct nwl_core_sub_impl update_pool_sub_impl = {
+	update_pool_sub_destroy
+};
+
+static struct nwl_update_pool *get_update_pool(struct nwl_core *core) {
+	struct nwl_core_sub *exist = nwl_core_get_sub(core, &update_pool_sub_impl);
+	if (exist) {
+		struct nwl_update_pool *pool = wl_container_of(exist, pool, sub);
+		if (pool->num_threads == core->update_threads) {
+			return pool;
+		}
+		wl_list_remove(&pool->sub.link);
+		update_pool_sub_destroy(&pool->sub);
+	}
+	struct nwl_update_pool *pool = calloc(1, sizeof(struct nwl_update_pool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_mutex_init(&pool->dirty_lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->threads = calloc(core->update_threads, sizeof(pthread_t));
+	for (uint32_t i = 0; i < core->update_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, update_pool_thread, pool) != 0) {
+			break;
+		}
+		pool->num_threads++;
+	}
+	pool->sub.impl = &update_pool_sub_impl;
+	nwl_core_add_sub(core, &pool->sub);
+	// Couldn't start them all? Then this is what there is, don't try again every pass.
+	core->update_threads = pool->num_threads;
+	return pool;
+}
+
+// Update workers mark their surfaces dirty, so the dirty list of a core with an update pool is only
+// touched with the pool's dirty_lock held, from any thread. Workers only exist along with the pool,
+// and the pool is only made or replaced on the dispatching thread between batches.
+// Not recursive: don't call out to anything that may mark surfaces while holding it!
+static pthread_mutex_t *get_dirty_lock(struct nwl_core *core) {
+	struct nwl_core_sub *sub = nwl_core_get_sub(core, &update_pool_sub_impl);
+	if (!sub) {
+		return NULL;
+	}
+	struct nwl_update_pool *pool = wl_container_of(sub, pool, sub);
+	return &pool->dirty_lock;
+}
+
+static void dirty_lock(struct nwl_core *core) {
+	pthread_mutex_t *lock = get_dirty_lock(core);
+	if (lock) {
+		pthread_mutex_lock(lock);
+	}
+}
+
+static void dirty_unlock(struct nwl_core *core) {
+	pthread_mutex_t *lock = get_dirty_lock(core);
+	if (lock) {
+		pthread_mutex_unlock(lock);
+	}
+}
+
 void surface_mark_dirty(struct nwl_surface *surface) {
-	// This isn't really thread-safe!
+	if (surface->queue) {
+		// Owned by another thread, which calls nwl_surface_handle_dirt itself.
+		if (surface->impl.dirty) {
+			surface->impl.dirty(surface);
+		}
+		return;
+	}
+	dirty_lock(surface->core);
 	if (wl_list_empty(&surface->dirtlink)) {
 		wl_list_insert(&surface->core->surfaces_dirty, &surface->dirtlink);
 	}
 	surface->core->has_dirty_surfaces = true;
+	dirty_unlock(surface->core);
 }
 
-static void nwl_wayland_poll_display(struct nwl_easy *easy, uint32_t events, void *data) {
-	UNUSED(data);
-	UNUSED(events);
-	if (wl_display_dispatch(easy->display) == -1) {
-		perror("Fatal Wayland error");
-		easy->has_errored = true;
-		easy->core.num_surfaces = 0;
-		easy->run_with_zero_surfaces = false;
+void surface_unmark_dirty(struct nwl_surface *surface) {
+	dirty_lock(surface->core);
+	if (!wl_list_empty(&surface->dirtlink)) {
+		wl_list_remove(&surface->dirtlink);
+		wl_list_init(&surface->dirtlink);
 	}
+	dirty_unlock(surface->core);
 }
 
-static void handle_dirty_surfaces(struct nwl_core *core) {
+static void run_parallel_updates(struct nwl_core *core, struct wl_array *batch) {
+	uint32_t num_jobs = batch->size / sizeof(struct nwl_surface*);
+	if (num_jobs == 0) {
+		return;
+	}
+	struct nwl_update_pool *pool = num_jobs > 1 ? get_update_pool(core) : NULL;
+	if (!pool || !pool->num_threads) {
+		struct nwl_surface **surface;
+		wl_array_for_each(surface, batch) {
+			nwl_surface_update(*surface);
+		}
+		batch->size = 0;
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->jobs = batch->data;
+	pool->num_jobs = num_jobs;
+	atomic_store(&pool->next_job, 0);
+	pool->working = pool->num_threads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	update_pool_run(pool);
+	pthread_mutex_lock(&pool->lock);
+	while (pool->working) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	batch->size = 0;
+}
+
+// Popups of surfaces going away can't stay, so they're marked too. All the way down.
+static void mark_dependent_popups(struct nwl_core *core) {
+	struct nwl_surface *surface;
+	bool marked;
+	do {
+		marked = false;
+		wl_list_for_each(surface, &core->surfaces, link) {
+			if (surface->role_id == NWL_SURFACE_ROLE_POPUP && surface->role.popup.parent &&
+					!(surface->states & NWL_SURFACE_STATE_DESTROY) &&
+					surface->role.popup.parent->states & NWL_SURFACE_STATE_DESTROY) {
+				nwl_surface_destroy_later(surface);
+				marked = true;
+			}
+		}
+	} while (marked);
+}
+
+// xdg-shell wants popups destroyed before their parent.
+static void destroy_popups_first(struct wl_list *batch, struct nwl_surface *surface) {
+	struct nwl_surface *child;
+	bool found;
+	do {
+		found = false;
+		wl_list_for_each(child, batch, dirtlink) {
+			if (child->role_id == NWL_SURFACE_ROLE_POPUP && child->role.popup.parent == surface) {
+				// Unlinks itself from the batch, so start over after.
+				destroy_popups_first(batch, child);
+				found = true;
+				break;
+			}
+		}
+	} while (found);
+	nwl_surface_destroy(surface);
+}
+
+static void destroy_dirty_surfaces(struct nwl_core *core) {
+	struct wl_list batch;
+	wl_list_init(&batch);
 	struct nwl_surface *surface, *stmp;
-	core->has_dirty_surfaces = false;
-	wl_list_for_each_safe(surface, stmp, &core->surfaces_dirty, dirtlink) {
-		if (surface->states & NWL_SURFACE_STATE_DESTROY) {
-			nwl_surface_destroy(surface);
-			// This might have destroyed other surfaces. Start over to be safe!
-			core->has_dirty_surfaces = true;
-			return;
-		} else if (surface->states & NWL_SURFACE_STATE_NEEDS_UPDATE && !surface->wl.frame_cb) {
-			nwl_surface_update(surface);
+	// A destroy callback may mark even more surfaces, so go until there's none left.
+	bool more;
+	do {
+		mark_dependent_popups(core);
+		dirty_lock(core);
+		wl_list_for_each_safe(surface, stmp, &core->surfaces_dirty, dirtlink) {
+			if (surface->states & NWL_SURFACE_STATE_DESTROY) {
+				wl_list_remove(&surface->dirtlink);
+				wl_list_insert(batch.prev, &surface->dirtlink);
+			}
 		}
-		wl_list_remove(&surface->dirtlink);
-		wl_list_init(&surface->dirtlink); // To make sure it's not in an undefined state..
+		dirty_unlock(core);
+		// Always take the head. Subsurfaces, or whatever the destroy callback takes with it,
+		// unlink themselves from the batch on the way out.
+		while (!wl_list_empty(&batch)) {
+			surface = wl_container_of(batch.next, surface, dirtlink);
+			destroy_popups_first(&batch, surface);
+		}
+		dirty_lock(core);
+		more = false;
+		wl_list_for_each(surface, &core->surfaces_dirty, dirtlink) {
+			if (surface->states & NWL_SURFACE_STATE_DESTROY) {
+				more = true;
+				break;
+			}
+		}
+		core->has_dirty_surfaces = more;
+		dirty_unlock(core);
+	} while (more);
+}
+
+static uint64_t elapsed_us(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+// Returns false if some surfaces were deferred to the next dispatch.
+static bool handle_dirty_surfaces(struct nwl_core *core) {
+	destroy_dirty_surfaces(core);
+	// Whatever gets dirty while updating waits for the next round.
+	// Without a budget there's only one bucket, and everything goes in order.
+	struct wl_list buckets[NWL_SURFACE_PRIORITY_POINTER + 1];
+	int top = core->update_budget_us ? NWL_SURFACE_PRIORITY_POINTER : 0;
+	for (int i = 0; i <= top; i++) {
+		wl_list_init(&buckets[i]);
+	}
+	dirty_lock(core);
+	if (top) {
+		while (!wl_list_empty(&core->surfaces_dirty)) {
+			struct nwl_surface *surface = wl_container_of(core->surfaces_dirty.next, surface, dirtlink);
+			wl_list_remove(&surface->dirtlink);
+			wl_list_insert(buckets[surface_urgency(surface)].prev, &surface->dirtlink);
+		}
+	} else {
+		wl_list_insert_list(&buckets[0], &core->surfaces_dirty);
 	}
+	wl_list_init(&core->surfaces_dirty);
+	dirty_unlock(core);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint32_t deferred = 0;
+	struct wl_array batch;
+	wl_array_init(&batch);
+	for (int i = top; i >= 0; i--) {
+		while (!wl_list_empty(&buckets[i])) {
+			struct nwl_surface *surface = wl_container_of(buckets[i].next, surface, dirtlink);
+			dirty_lock(core);
+			wl_list_remove(&surface->dirtlink);
+			wl_list_init(&surface->dirtlink);
+			dirty_unlock(core);
+			if (surface->states & NWL_SURFACE_STATE_DESTROY) {
+				// Marked by an earlier update in this pass.
+				surface_mark_dirty(surface);
+			} else if (!surface_wants_update(surface)) {
+				continue;
+			} else if (top && i != NWL_SURFACE_PRIORITY_POINTER && elapsed_us(&start) >= core->update_budget_us) {
+				if (surface->deferrals < UINT8_MAX) {
+					surface->deferrals++;
+				}
+				surface_mark_dirty(surface);
+				deferred++;
+			} else if (core->update_threads && surface->flags & NWL_SURFACE_FLAG_PARALLEL_UPDATE) {
+				surface->deferrals = 0;
+				struct nwl_surface **job = wl_array_add(&batch, sizeof(struct nwl_surface*));
+				*job = surface;
+			} else {
+				surface->deferrals = 0;
+				nwl_surface_update(surface);
+			}
+		}
+		// Joined before the next bucket, and before anything gets flushed.
+		run_parallel_updates(core, &batch);
+	}
+	wl_array_release(&batch);
+	core->updates_deferred = deferred;
+	core->updates_deferred_total += deferred;
+	return deferred == 0;
 }
 
 void nwl_core_handle_dirt(struct nwl_core *core) {
 	while(core->has_dirty_surfaces) {
-		handle_dirty_surfaces(core);
+		if (!handle_dirty_surfaces(core)) {
+			// Out of budget, the rest goes after the next round of events.
+			break;
+		}
 	}
 }
 
@@ -418,39 +976,104 @@ void announce_outputs(struct nwl_easy *easy) {
 	bool roundtripped = false;
 	wl_list_for_each(output, &easy->core.outputs, link) {
 		struct nwl_easy_output *easyoutput = wl_container_of(output, easyoutput, output);
-		if (!easyoutput->announced) {
-			if (easyoutput->output.is_done != 0 && !roundtripped) {
+		if (!easyoutput->announced && easyoutput->output.is_done != 0) {
+			if (easy->async_startup) {
+				// It'll be announced when it's done.
+				continue;
+			}
+			if (!roundtripped) {
 				// Roundtrip to ensure it's done. Is this dangerous?
 				wl_display_roundtrip(easy->display);
 				roundtripped = true;
 			}
-			easyoutput->announced = true;
-			if (easy->events.global_bound != NULL) {
-				struct nwl_bound_global glob = {
-					.global.output = output,
-					.kind = NWL_BOUND_GLOBAL_OUTPUT,
-				};
-				easy->events.global_bound(&glob);
-			}
 		}
+		announce_output(easy, easyoutput);
+	}
+}
+
+static int poll_wait(struct nwl_poll *poll, int timeout) {
+#if NWL_HAS_IO_URING
+	if (poll->ring) {
+		return nwl_uring_wait(poll, timeout);
+	}
+#endif
+	return epoll_wait(poll->epfd, poll->ev, poll->numfds, timeout);
+}
+
+static bool poll_data_alive(struct nwl_poll *poll, struct nwl_poll_data *data) {
+	struct nwl_poll_data *alive;
+	wl_list_for_each(alive, &poll->data, link) {
+		if (alive == data) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void sort_poll_events(struct epoll_event *ev, int nfds) {
+	// Hardly ever more than a handful, insertion sort it is.
+	for (int i = 1; i < nfds; i++) {
+		struct epoll_event cur = ev[i];
+		int prio = ((struct nwl_poll_data*)cur.data.ptr)->priority;
+		int j = i - 1;
+		while (j >= 0 && ((struct nwl_poll_data*)ev[j].data.ptr)->priority < prio) {
+			ev[j+1] = ev[j];
+			j--;
+		}
+		ev[j+1] = cur;
 	}
 }
 
 bool nwl_easy_dispatch(struct nwl_easy *easy, int timeout) {
-	wl_display_flush(easy->display);
-	int nfds = epoll_wait(easy->poll.epfd, easy->poll.ev, easy->poll.numfds, timeout);
+	// prepare_read fails if there are already events queued, don't sleep if so.
+	easy->display_reading = wl_display_prepare_read(easy->display) == 0;
+	if (!easy->display_reading || easy->display_has_pending || easy->core.has_dirty_surfaces) {
+		timeout = 0;
+	}
+	flush_display(easy);
+	int nfds = poll_wait(&easy->poll, timeout);
 	if (nfds == -1 && errno != EINTR) {
 		perror("error while polling");
+		finish_display_read(easy, false);
 		return false;
 	}
+	sort_poll_events(easy->poll.ev, nfds);
+	// Callbacks may add or remove fds, which moves poll.ev around and frees poll data.
+	// So work off a copy, and check the data is still there before each callback.
+	struct epoll_event ev[nfds > 0 ? nfds : 1];
+	memcpy(ev, easy->poll.ev, sizeof(struct epoll_event) * (nfds > 0 ? nfds : 0));
+	// The read intent must be resolved before any other callback gets to touch the display,
+	// otherwise a roundtrip in there would deadlock.
+	bool display_handled = false;
 	for (int i = 0; i < nfds; i++) {
-		struct nwl_poll_data *data = easy->poll.ev[i].data.ptr;
-		data->callback(easy, easy->poll.ev[i].events, data->userdata);
+		struct nwl_poll_data *data = ev[i].data.ptr;
+		if (data->callback == nwl_wayland_poll_display) {
+			data->callback(easy, ev[i].events, data->userdata);
+			display_handled = true;
+			break;
+		}
+	}
+	if (!display_handled) {
+		finish_display_read(easy, false);
+		dispatch_display_pending(easy);
+	}
+	for (int i = 0; i < nfds; i++) {
+		struct nwl_poll_data *data = ev[i].data.ptr;
+		if (poll_data_alive(&easy->poll, data) && data->callback != nwl_wayland_poll_display) {
+			data->callback(easy, ev[i].events, data->userdata);
+		}
 	}
 	if (easy->has_new_outputs) {
 		announce_outputs(easy);
 		easy->has_new_outputs = false;
 	}
+#if NWL_HAS_SEAT
+	// Everything the tablets sent this round goes out in one go.
+	struct nwl_seat *seat;
+	wl_list_for_each(seat, &easy->core.seats, link) {
+		nwl_seat_flush_tablet(seat);
+	}
+#endif
 	if (easy->core.has_dirty_surfaces) {
 		nwl_core_handle_dirt(&easy->core);
 	}
@@ -459,7 +1082,7 @@ bool nwl_easy_dispatch(struct nwl_easy *easy, int timeout) {
 
 void nwl_easy_run(struct nwl_easy *easy) {
 	// Everything about this seems very flaky.. but it works!
-	while (easy->run_with_zero_surfaces || easy->core.num_surfaces) {
+	while (easy->run_with_zero_surfaces || easy->core.num_surfaces || easy->startup_cb) {
 		if (!nwl_easy_dispatch(easy, -1)) {
 			return;
 		}
@@ -474,8 +1097,35 @@ void nwl_core_init(struct nwl_core *core) {
 	wl_list_init(&core->subs);
 }
 
+static void easy_prewarm(struct nwl_easy *easy) {
+	struct nwl_output *output;
+	wl_list_for_each(output, &easy->core.outputs, link) {
+		easy_prewarm_cursor(easy, output->scale);
+	}
+}
+
+static void handle_startup_done(void *data, struct wl_callback *cb, uint32_t cb_data) {
+	UNUSED(cb_data);
+	struct nwl_easy *easy = data;
+	wl_callback_destroy(cb);
+	easy->startup_cb = NULL;
+	nwl_core_startup_trace(&easy->core, "globals bound");
+	easy_prewarm(easy);
+	// All the initial globals are in and bound. Output info may still be on its way.
+	if (easy->events.ready) {
+		easy->events.ready(easy);
+	}
+}
+
+static const struct wl_callback_listener startup_listener = {
+	handle_startup_done
+};
+
 bool nwl_easy_init(struct nwl_easy *easy) {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	nwl_core_init(&easy->core);
+	startup_trace_begin(&easy->core, &start);
 	wl_list_init(&easy->globals);
 	wl_list_init(&easy->poll.data);
 	easy->display = wl_display_connect(NULL);
@@ -483,48 +1133,60 @@ bool nwl_easy_init(struct nwl_easy *easy) {
 		fprintf(stderr, "Couldn't connect to Wayland compositor.\n");
 		return false;
 	}
+	nwl_core_startup_trace(&easy->core, "connected");
 	easy->registry = wl_display_get_registry(easy->display);
 	wl_registry_add_listener(easy->registry, &reg_listener, easy);
-	easy->poll.epfd = epoll_create1(0);
+	easy->poll.epfd = -1;
 	easy->poll.ev = NULL;
+	easy->poll.ring = NULL;
+	easy->poll.uring_next_id = 0;
+#if NWL_HAS_IO_URING
+	if (easy->poll.backend == NWL_POLL_BACKEND_IO_URING && !nwl_uring_init(&easy->poll)) {
+		fprintf(stderr, "Couldn't set up io_uring, falling back to epoll.\n");
+		easy->poll.backend = NWL_POLL_BACKEND_EPOLL;
+	}
+#else
+	easy->poll.backend = NWL_POLL_BACKEND_EPOLL;
+#endif
+	if (easy->poll.backend == NWL_POLL_BACKEND_EPOLL) {
+		easy->poll.epfd = epoll_create1(EPOLL_CLOEXEC);
+	}
+	easy->display_reading = false;
+	easy->display_has_pending = false;
+	easy->core.display_congested = false;
+	if (easy->dispatch_budget == 0) {
+		easy->dispatch_budget = NWL_EASY_DEFAULT_DISPATCH_BUDGET;
+	}
+	easy->startup_cb = NULL;
+	if (easy->async_startup) {
+		easy->startup_cb = wl_display_sync(easy->display);
+		wl_callback_add_listener(easy->startup_cb, &startup_listener, easy);
+		nwl_easy_add_fd(easy, wl_display_get_fd(easy->display), EPOLLIN, nwl_wayland_poll_display, NULL);
+		nwl_easy_set_fd_priority(easy, wl_display_get_fd(easy->display), NWL_POLL_PRIORITY_INPUT);
+		return true;
+	}
 	if (wl_display_roundtrip(easy->display) == -1) {
 		fprintf(stderr, "Initial roundtrip failed.\n");
 		wl_registry_destroy(easy->registry);
 		wl_display_disconnect(easy->display);
 		return false;
 	}
+	nwl_core_startup_trace(&easy->core, "globals bound");
 	nwl_easy_add_fd(easy, wl_display_get_fd(easy->display), EPOLLIN, nwl_wayland_poll_display, NULL);
+	nwl_easy_set_fd_priority(easy, wl_display_get_fd(easy->display), NWL_POLL_PRIORITY_INPUT);
 
-	// Ask xdg output manager for xdg_outputs in case wl_output globals were sent before it.
-	if (easy->core.wl.xdg_output_manager) {
-		struct nwl_output *nwloutput;
-		wl_list_for_each(nwloutput, &easy->core.outputs, link) {
-			if (nwloutput->xdg_output) {
-				continue;
-			}
-			nwloutput->is_done = 2;
-			nwloutput->xdg_output = zxdg_output_manager_v1_get_xdg_output(easy->core.wl.xdg_output_manager, nwloutput->output);
-			zxdg_output_v1_add_listener(nwloutput->xdg_output, &xdg_output_listener, nwloutput);
-		}
-	}
-#if NWL_HAS_SEAT
-	if (easy->core.wl.data_device_manager) {
-		struct nwl_seat *seat;
-		wl_list_for_each((seat), &easy->core.seats, link) {
-			if (seat->data_device.wl) {
-				continue;
-			}
-			seat->data_device.wl = wl_data_device_manager_get_data_device(easy->core.wl.data_device_manager, seat->wl_seat);
-		}
-	}
-#endif
 	// Extra roundtrip so output information is properly filled in
 	wl_display_roundtrip(easy->display);
+	nwl_core_startup_trace(&easy->core, "outputs done");
+	easy_prewarm(easy);
 	// Let them know there are outputs!
 	if (easy->has_new_outputs) {
 		announce_outputs(easy);
 		easy->has_new_outputs = false;
 	}
+	if (easy->events.ready) {
+		easy->events.ready(easy);
+	}
 	return true;
 }
 
@@ -537,7 +1199,14 @@ static void poll_destroy(struct nwl_poll *poll) {
 	if (poll->ev) {
 		free(poll->ev);
 	}
-	close(poll->epfd);
+#if NWL_HAS_IO_URING
+	if (poll->ring) {
+		nwl_uring_destroy(poll);
+	}
+#endif
+	if (poll->epfd != -1) {
+		close(poll->epfd);
+	}
 }
 
 void nwl_core_deinit(struct nwl_core *core) {
@@ -552,12 +1221,12 @@ void nwl_core_deinit(struct nwl_core *core) {
 	}
 	// This should be moved out of here.
 #if NWL_HAS_SEAT
-	if (core->cursor_theme) {
-		wl_cursor_theme_destroy(core->cursor_theme);
-	}
 	if (core->wl.cursor_shape_manager) {
 		wp_cursor_shape_manager_v1_destroy(core->wl.cursor_shape_manager);
 	}
+	if (core->wl.tablet_manager) {
+		zwp_tablet_manager_v2_destroy(core->wl.tablet_manager);
+	}
 #endif
 	if (core->wl.compositor) {
 		wl_compositor_destroy(core->wl.compositor);
@@ -586,6 +1255,9 @@ void nwl_core_deinit(struct nwl_core *core) {
 }
 
 void nwl_easy_deinit(struct nwl_easy *easy) {
+	if (easy->startup_cb) {
+		wl_callback_destroy(easy->startup_cb);
+	}
 	struct nwl_easy_global *glob, *globtmp;
 	wl_list_for_each_safe(glob, globtmp, &easy->globals, link) {
 		wl_list_remove(&glob->link);
@@ -613,3 +1285,68 @@ struct nwl_core_sub *nwl_core_get_sub(struct nwl_core *core, const struct nwl_co
 void nwl_core_add_sub(struct nwl_core *core, struct nwl_core_sub *sub) {
 	wl_list_insert(&core->subs, &sub->link);
 }
+
+struct nwl_startup_trace {
+	struct nwl_core_sub sub;
+	struct timespec start;
+	struct timespec last;
+	atomic_bool finished; // Parallel updates may race to submit the first buffer
+};
+
+static void startup_trace_sub_destroy(struct nwl_core_sub *sub) {
+	struct nwl_startup_trace *trace = wl_container_of(sub, trace, sub);
+	free(trace);
+}
+
+static const struct nwl_core_sub_impl startup_trace_sub_impl = {
+	startup_trace_sub_destroy
+};
+
+static double timespec_ms(const struct timespec *from, const struct timespec *to) {
+	return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+// Enabled by setting NWL_STARTUP_TRACE in the environment.
+void startup_trace_begin(struct nwl_core *core, const struct timespec *start) {
+	const char *env = getenv("NWL_STARTUP_TRACE");
+	if (!env || !*env || nwl_core_get_sub(core, &startup_trace_sub_impl)) {
+		return;
+	}
+	struct nwl_startup_trace *trace = calloc(1, sizeof(struct nwl_startup_trace));
+	trace->sub.impl = &startup_trace_sub_impl;
+	trace->start = *start;
+	trace->last = *start;
+	nwl_core_add_sub(core, &trace->sub);
+}
+
+static void startup_trace_print(struct nwl_startup_trace *trace, const char *phase) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(stderr, "nwl startup: %-24s %9.3f ms (+%.3f ms)\n", phase,
+		timespec_ms(&trace->start, &now), timespec_ms(&trace->last, &now));
+	trace->last = now;
+}
+
+void nwl_core_startup_trace(struct nwl_core *core, const char *phase) {
+	struct nwl_core_sub *sub = nwl_core_get_sub(core, &startup_trace_sub_impl);
+	if (!sub) {
+		return;
+	}
+	struct nwl_startup_trace *trace = wl_container_of(sub, trace, sub);
+	if (atomic_load(&trace->finished)) {
+		return;
+	}
+	startup_trace_print(trace, phase);
+}
+
+void startup_trace_finish(struct nwl_core *core) {
+	struct nwl_core_sub *sub = nwl_core_get_sub(core, &startup_trace_sub_impl);
+	if (!sub) {
+		return;
+	}
+	struct nwl_startup_trace *trace = wl_container_of(sub, trace, sub);
+	// Only the first one through gets to print, the dispatch thread is waiting on the rest.
+	if (!atomic_exchange(&trace->finished, true)) {
+		startup_trace_print(trace, "first commit");
+	}
+}
@@ -60,6 +60,7 @@ pub const WlSubcompositor = WaylandObject("wl_subcompositor");
 pub const WlDataDeviceManager = WaylandObject("wl_data_device_manager");
 pub const WlBuffer = WaylandObject("wl_buffer");
 pub const WlCallback = WaylandObject("wl_callback");
+pub const WlEventQueue = WaylandObject("wl_event_queue");
 pub const WlDataDevice = WaylandObject("wl_data_device");
 pub const WlDataOffer = WaylandObject("wl_data_offer");
 pub const WlDataSource = WaylandObject("wl_data_source");
@@ -81,6 +82,10 @@ pub const XdgPopup = WaylandObject("xdg_popup");
 pub const ZwlrLayerSurfaceV1 = WaylandObject("zwlr_layer_surface_v1");
 pub const WpCursorShapeDeviceV1 = WaylandObject("wp_cursor_shape_device_v1");
 pub const WpCursorShapeManagerV1 = WaylandObject("wp_cursor_shape_manager_v1");
+pub const ZwpTabletManagerV2 = WaylandObject("zwp_tablet_manager_v2");
+pub const ZwpTabletSeatV2 = WaylandObject("zwp_tablet_seat_v2");
+pub const ZwpTabletToolV2 = WaylandObject("zwp_tablet_tool_v2");
+pub const ZwpTabletV2 = WaylandObject("zwp_tablet_v2");
 pub const XkbContext = opaque {};
 pub const WlCursorTheme = opaque {};
 
@@ -97,6 +102,7 @@ pub const Output = extern struct {
     height: i32,
     name: ?[*:0]const u8,
     description: ?[*:0]const u8,
+    done: ?*const fn (*Output) callconv(.c) void,
 
     extern fn nwl_output_init(nwl_output: *Output, core: *Core, wl_output: *WlOutput) void;
     extern fn nwl_output_deinit(nwl_output: *Output) void;
@@ -208,6 +214,8 @@ pub const KeyboardEvent = extern struct {
     keycode: XkbKeycode,
     utf8: [16]u8,
     serial: u32,
+    repeat_count: u32,
+    repeat_text: ?[*:0]const u8,
 };
 
 pub const PointerEvent = extern struct {
@@ -253,10 +261,120 @@ pub const PointerEvent = extern struct {
     focus: bool,
 };
 
+pub const PointerSample = extern struct {
+    time: u32,
+    surface_x: WlFixed,
+    surface_y: WlFixed,
+    surface: ?*Surface,
+    buttons: PointerEvent.Buttons,
+};
+
+pub const TouchPoint = extern struct {
+    const Changed = packed struct(u8) {
+        down: bool,
+        up: bool,
+        motion: bool,
+        shape: bool,
+        orientation: bool,
+        _padding: u3,
+    };
+    id: i32,
+    active: bool,
+    changed: Changed,
+    surface: ?*Surface,
+    serial: u32,
+    time: u32,
+    surface_x: WlFixed,
+    surface_y: WlFixed,
+    major: WlFixed,
+    minor: WlFixed,
+    orientation: WlFixed,
+};
+
+pub const TouchEvent = extern struct {
+    pub const max_points = 10;
+    points: [max_points]TouchPoint,
+    cancelled: bool,
+};
+
+pub const TabletSample = extern struct {
+    const Changed = packed struct(u16) {
+        proximity: bool,
+        tip: bool,
+        motion: bool,
+        pressure: bool,
+        distance: bool,
+        tilt: bool,
+        rotation: bool,
+        slider: bool,
+        wheel: bool,
+        button: bool,
+        _padding: u6,
+    };
+    const Buttons = packed struct(u8) {
+        stylus: bool,
+        stylus2: bool,
+        stylus3: bool,
+        _padding: u5,
+    };
+    time: u32,
+    changed: Changed,
+    proximity: bool,
+    down: bool,
+    buttons: Buttons,
+    surface_x: WlFixed,
+    surface_y: WlFixed,
+    pressure: u16,
+    distance: u16,
+    tilt_x: WlFixed,
+    tilt_y: WlFixed,
+    rotation: WlFixed,
+    slider: i32,
+    wheel: WlFixed,
+    wheel_clicks: i32,
+};
+
+pub const TabletTool = extern struct {
+    link: WlList,
+    seat: *Seat,
+    wl: *ZwpTabletToolV2,
+    type: u32,
+    capabilities: u32,
+    hardware_serial: u64,
+    focus: ?*Surface,
+    serial: u32,
+    state: TabletSample,
+    userdata: ?*anyopaque,
+};
+
+pub const TabletEvent = extern struct {
+    tool: *TabletTool,
+    samples: [*]const TabletSample,
+    num_samples: u32,
+    serial: u32,
+
+    pub fn slice(event: *const TabletEvent) []const TabletSample {
+        return event.samples[0..event.num_samples];
+    }
+};
+
+const PointerHistory = extern struct {
+    samples: ?[*]PointerSample,
+    capacity: u32,
+    head: u32,
+    count: u32,
+    overwritten: u32,
+};
+
 const PointerSurface = extern struct {
     shape_device: ?*WpCursorShapeDeviceV1,
     xcursor_surface: ?*WlSurface,
     nwl: ?*Surface,
+    xcursor: ?*anyopaque,
+    xcursor_fd: c_int,
+    xcursor_image: c_int,
+    xcursor_scale: i32,
+    xcursor_pending: ?[*:0]u8,
 };
 
 pub const Seat = extern struct {
@@ -281,19 +399,37 @@ pub const Seat = extern struct {
     keyboard_xkb: KeymapXkb,
     keyboard_compose_enabled: bool,
     keyboard_repeat_enabled: bool,
+    keyboard_repeat_coalesce: bool,
     keyboard_focus: ?*Surface,
     keyboard_repeat_rate: i32,
     keyboard_repeat_delay: i32,
     keyboard_repeat_fd: c_int,
+    keyboard_keymap_async: bool,
+    keyboard_keymap_fd: c_int,
+    keyboard_keymap_job: ?*anyopaque,
+    keyboard_repeat_text: WlArray(u8),
     keyboard_event: KeyboardEvent,
+    keybinds: ?*Keybinds,
+    keybind_mods: u32,
+    keybind_state: u32,
+    keybind_keys: WlArray(u32),
+    tablet: extern struct {
+        wl: ?*ZwpTabletSeatV2,
+        tools: WlListHead(TabletTool, .link),
+        tablets: WlArray(*ZwpTabletV2),
+        samples: WlArray(TabletSample),
+        pending_tool: ?*TabletTool,
+        pending_focus: ?*Surface,
+    },
     touch: ?*WlTouch,
-    touch_focus: ?*Surface,
+    touch_event: TouchEvent,
     touch_serial: u32,
     pointer: ?*WlPointer,
     pointer_focus: ?*Surface,
     pointer_prev_focus: ?*Surface,
     pointer_surface: PointerSurface,
     pointer_event: PointerEvent,
+    pointer_history: PointerHistory,
     name: ?[*:0]const u8,
     userdata: ?*anyopaque,
 
@@ -304,10 +440,55 @@ pub const Seat = extern struct {
     extern fn nwl_seat_set_pointer_surface(seat: *Seat, surface: *Surface, hotspot_x: i32, hotspot_y: i32) bool;
     extern fn nwl_seat_start_drag(seat: *Seat, data_source: *WlDataSource, icon: ?*Surface) void;
 
+    extern fn nwl_seat_set_pointer_history(seat: *Seat, capacity: u32) bool;
+    extern fn nwl_seat_drain_pointer_history(seat: *Seat, samples: [*]PointerSample, max: u32) u32;
+    extern fn nwl_seat_flush_tablet(seat: *Seat) void;
+    extern fn nwl_seat_set_selection(seat: *Seat, source: ?*DataSource, serial: u32) void;
+    extern fn nwl_seat_receive_offer(seat: *Seat, easy: *Easy, offer: *DataOffer, mime: [*:0]const u8, mode: DataReceive.Mode, dest_fd: c_int) ?*DataReceive;
+    extern fn nwl_seat_keymap_cache_clear() void;
+    extern fn nwl_seat_handle_keymap(seat: *Seat) void;
+
+    pub const Keybinds = opaque {
+        pub const Mods = packed struct(u32) {
+            ctrl: bool = false,
+            shift: bool = false,
+            alt: bool = false,
+            super: bool = false,
+            _pad: u28 = 0,
+        };
+        pub const Callback = *const fn (*Seat, ?*Surface, ?*anyopaque) callconv(.c) void;
+        extern fn nwl_keybinds_create() *Keybinds;
+        extern fn nwl_keybinds_destroy(binds: *Keybinds) void;
+        extern fn nwl_keybinds_add(binds: *Keybinds, spec: [*:0]const u8, callback: Callback, data: ?*anyopaque) bool;
+        pub const create = nwl_keybinds_create;
+        pub const destroy = nwl_keybinds_destroy;
+        pub fn add(binds: *Keybinds, spec: [*:0]const u8, callback: Callback, data: ?*anyopaque) !void {
+            if (!binds.nwl_keybinds_add(spec, callback, data)) {
+                return error.InvalidKeybind;
+            }
+        }
+    };
+
     pub const init = nwl_seat_init;
     pub const deinit = nwl_seat_deinit;
+    pub const keymapCacheClear = nwl_seat_keymap_cache_clear;
+    pub const handleKeymap = nwl_seat_handle_keymap;
     pub const setPointerCursor = nwl_seat_set_pointer_cursor;
     pub const setPointerShape = nwl_seat_set_pointer_shape;
+    pub const flushTablet = nwl_seat_flush_tablet;
+    pub const setSelection = nwl_seat_set_selection;
+    pub fn receiveOffer(seat: *Seat, easy: *Easy, offer: *DataOffer, mime: [*:0]const u8, mode: DataReceive.Mode, dest_fd: c_int) !*DataReceive {
+        return seat.nwl_seat_receive_offer(easy, offer, mime, mode, dest_fd) orelse error.ReceiveFailed;
+    }
+    pub fn setPointerHistory(seat: *Seat, capacity: u32) !void {
+        if (!seat.nwl_seat_set_pointer_history(capacity)) {
+            return error.OutOfMemory;
+        }
+    }
+    pub fn drainPointerHistory(seat: *Seat, samples: []PointerSample) []PointerSample {
+        const n = seat.nwl_seat_drain_pointer_history(samples.ptr, @intCast(samples.len));
+        return samples[0..n];
+    }
     pub fn setPointerSurface(seat: *Seat, surface: *Surface, hotspot_x: i32, hotspot_y: i32) !void {
         if (!seat.nwl_seat_set_pointer_surface(surface, hotspot_x, hotspot_y)) {
             //TODO: improve this
@@ -322,6 +503,68 @@ pub const Seat = extern struct {
     }
 };
 
+pub const DataReceive = extern struct {
+    pub const Mode = enum(c_int) { chunks = 0, whole, fd };
+    easy: *Easy,
+    fd: c_int,
+    dest_fd: c_int,
+    owns_dest_fd: bool,
+    dest_blocked: bool,
+    in_callback: bool,
+    cancelled: bool,
+    mode: u8,
+    received: usize,
+    buffer: WlArray(u8),
+    data: ?*const fn (*DataReceive, ?*const anyopaque, usize) callconv(.c) void = null,
+    done: ?*const fn (*DataReceive, bool) callconv(.c) void = null,
+    userdata: ?*anyopaque = null,
+
+    extern fn nwl_data_receive_cancel(receive: *DataReceive) void;
+    pub const cancel = nwl_data_receive_cancel;
+};
+
+pub const DataPayload = extern struct {
+    pub const Type = enum(u8) { buffer = 0, fd, callback };
+    mime: [*:0]u8,
+    type: Type,
+    data: ?*anyopaque,
+    size: usize,
+    fd: c_int,
+    sealed: bool,
+    callback: ?DataSource.Callback,
+};
+
+pub const DataSource = extern struct {
+    pub const Callback = *const fn (*DataSource, [*:0]const u8, *WlArray(u8)) callconv(.c) void;
+    easy: *Easy,
+    wl: *WlDataSource,
+    payloads: WlArray(DataPayload),
+    sends: WlList,
+    action: u32,
+    cancelled: ?*const fn (*DataSource) callconv(.c) void = null,
+    dnd_finished: ?*const fn (*DataSource) callconv(.c) void = null,
+    userdata: ?*anyopaque = null,
+
+    extern fn nwl_data_source_create(easy: *Easy) ?*DataSource;
+    extern fn nwl_data_source_destroy(source: *DataSource) void;
+    extern fn nwl_data_source_offer_buffer(source: *DataSource, mime: [*:0]const u8, data: [*]const u8, size: usize) bool;
+    extern fn nwl_data_source_offer_fd(source: *DataSource, mime: [*:0]const u8, fd: c_int) bool;
+    extern fn nwl_data_source_offer_callback(source: *DataSource, mime: [*:0]const u8, callback: Callback) bool;
+    pub fn create(easy: *Easy) !*DataSource {
+        return nwl_data_source_create(easy) orelse error.NoDataDeviceManager;
+    }
+    pub const destroy = nwl_data_source_destroy;
+    pub fn offerBuffer(source: *DataSource, mime: [*:0]const u8, data: []const u8) !void {
+        if (!source.nwl_data_source_offer_buffer(mime, data.ptr, data.len)) return error.AlreadyOffered;
+    }
+    pub fn offerFd(source: *DataSource, mime: [*:0]const u8, fd: c_int) !void {
+        if (!source.nwl_data_source_offer_fd(mime, fd)) return error.OfferFailed;
+    }
+    pub fn offerCallback(source: *DataSource, mime: [*:0]const u8, callback: Callback) !void {
+        if (!source.nwl_data_source_offer_callback(mime, callback)) return error.AlreadyOffered;
+    }
+};
+
 pub const DndEvent = extern struct {
     const EventType = enum(u8) { motion = 0, enter, left, drop };
     type: EventType,
@@ -335,8 +578,13 @@ pub const DndEvent = extern struct {
 };
 
 pub const DataOffer = extern struct {
-    mime: WlArray([*:0]u8),
+    pub const set_bits = 256;
+    mime_atoms: WlArray(u32),
+    mime_set: [set_bits / 64]u64,
     offer: ?*WlDataOffer,
+
+    extern fn nwl_data_offer_has_mime(offer: *const DataOffer, atom: u32) bool;
+    pub const hasMime = nwl_data_offer_has_mime;
 };
 
 pub const Cairo = struct {
@@ -347,11 +595,22 @@ pub const Cairo = struct {
         surface: *cairo_surface_t,
         rerender: bool,
     };
+    pub const Rect = extern struct {
+        x: i32,
+        y: i32,
+        width: i32,
+        height: i32,
+    };
     pub const Renderer = extern struct {
         shm: ShmBufferMan,
         cairo_surfaces: [ShmBufferMan.max_buffers]CairoSurface,
         next_buffer: c_int,
         prev_buffer: c_int,
+        pipeline: ?*Pipeline,
+
+        pub const Pipeline = opaque {};
+        pub const RenderFn = *const fn (*CairoSurface, ?*anyopaque) callconv(.c) void;
+        pub const RenderDoneFn = *const fn (*Renderer, ?*anyopaque) callconv(.c) void;
 
         extern fn nwl_cairo_renderer_init(renderer: *Renderer) void;
         pub const init = nwl_cairo_renderer_init;
@@ -359,22 +618,40 @@ pub const Cairo = struct {
         pub const deinit = nwl_cairo_renderer_finish;
         extern fn nwl_cairo_renderer_submit(renderer: *Renderer, surface: *Surface, x: i32, y: i32) void;
         pub const submit = nwl_cairo_renderer_submit;
+        extern fn nwl_cairo_renderer_submit_shared(renderer: *Renderer, surfaces: [*]const *Surface, num_surfaces: c_uint, x: i32, y: i32) void;
+        pub fn submitShared(renderer: *Renderer, surfaces: []const *Surface, x: i32, y: i32) void {
+            renderer.nwl_cairo_renderer_submit_shared(surfaces.ptr, @intCast(surfaces.len), x, y);
+        }
         extern fn nwl_cairo_renderer_get_surface(renderer: *Renderer, surface: *Surface, copyprevious: bool) ?*CairoSurface;
         pub const getSurface = nwl_cairo_renderer_get_surface;
+        extern fn nwl_cairo_renderer_get_surface_scrolled(renderer: *Renderer, surface: *Surface, dx: i32, dy: i32, region: ?*const Rect, exposed: *[2]Rect, num_exposed: *c_int) ?*CairoSurface;
+        pub fn getSurfaceScrolled(renderer: *Renderer, surface: *Surface, dx: i32, dy: i32, region: ?*const Rect, exposed: *[2]Rect) ?struct { *CairoSurface, []Rect } {
+            var num: c_int = 0;
+            const csurf = renderer.nwl_cairo_renderer_get_surface_scrolled(surface, dx, dy, region, exposed, &num) orelse return null;
+            return .{ csurf, exposed[0..@intCast(num)] };
+        }
+        extern fn nwl_cairo_renderer_set_pipelined(renderer: *Renderer, easy: *Easy, render: RenderFn, done: ?RenderDoneFn) bool;
+        pub fn setPipelined(renderer: *Renderer, easy: *Easy, render: RenderFn, done: ?RenderDoneFn) !void {
+            if (!renderer.nwl_cairo_renderer_set_pipelined(easy, render, done)) return error.PipelineFailed;
+        }
+        extern fn nwl_cairo_renderer_submit_async(renderer: *Renderer, surface: *Surface, snapshot: ?*anyopaque, x: i32, y: i32) bool;
+        pub const submitAsync = nwl_cairo_renderer_submit_async;
     };
 };
 
 extern fn wl_proxy_marshal(p: ?*WlProxy, opcode: u32, ...) void;
 
-const Error = error{ InitFailed, RoleSetFailed, SurfaceCreateFailed };
+const Error = error{ InitFailed, RoleSetFailed, QueueSetFailed, SurfaceCreateFailed };
 
 pub const Surface = extern struct {
     const GenericSurfaceFn = *const fn (*Surface) callconv(.c) void;
     const RoleId = enum(u8) { none, toplevel, popup, layer, sub, cursor, dragicon };
+    pub const Priority = enum(u8) { background = 0, visible, focused, pointer };
     const Flags = packed struct(u32) {
         no_autoscale: bool = false,
         no_autocursor: bool = false,
-        padding: u30 = 0,
+        parallel_update: bool = false,
+        padding: u29 = 0,
     };
 
     const SurfaceStates = packed struct(u32) {
@@ -399,9 +676,12 @@ pub const Surface = extern struct {
         destroy: ?GenericSurfaceFn = null,
         input_pointer: ?*const fn (*Surface, *Seat, *PointerEvent) callconv(.c) void = null,
         input_keyboard: ?*const fn (*Surface, *Seat, *KeyboardEvent) callconv(.c) void = null,
+        input_touch: ?*const fn (*Surface, *Seat, *TouchEvent) callconv(.c) void = null,
+        input_tablet: ?*const fn (*Surface, *Seat, *TabletEvent) callconv(.c) void = null,
         dnd: ?*const fn (*Surface, *Seat, *DndEvent) callconv(.c) void = null,
         configure: ?*const fn (*Surface, u32, u32) callconv(.c) void = null,
         close: ?GenericSurfaceFn = null,
+        dirty: ?GenericSurfaceFn = null,
     };
     const RoleUnion = extern union {
         toplevel: extern struct {
@@ -423,6 +703,7 @@ pub const Surface = extern struct {
             lx: i32,
             ly: i32,
             reposition_token: u32,
+            parent: ?*Surface,
         },
         layer: extern struct { wl: *ZwlrLayerSurfaceV1 },
         subsurface: extern struct {
@@ -434,6 +715,7 @@ pub const Surface = extern struct {
     link: WlList = .{},
     dirtlink: WlList = .{},
     core: *Core = undefined,
+    queue: ?*WlEventQueue = null,
     wl: extern struct {
         surface: *WlSurface,
         xdg_surface: ?*XdgSurface,
@@ -458,6 +740,8 @@ pub const Surface = extern struct {
     title: ?[*:0]u8 = null,
     role_id: RoleId = undefined,
     defer_update: bool = undefined,
+    priority: Priority = .visible,
+    deferrals: u8 = 0,
     role: RoleUnion = undefined,
     frame: u32 = 0,
     impl: SurfaceImpl = .{},
@@ -475,6 +759,8 @@ pub const Surface = extern struct {
     extern fn nwl_surface_init(surface: *Surface, core: *Core, title: [*:0]const u8) void;
     extern fn nwl_surface_buffer_submitted(surface: *Surface) void;
     extern fn nwl_surface_request_callback(surface: *Surface) void;
+    extern fn nwl_surface_set_queue(surface: *Surface, queue: ?*WlEventQueue) bool;
+    extern fn nwl_surface_handle_dirt(surface: *Surface) void;
     pub fn commit(self: *Surface) void {
         if (@hasDecl(WlSurface, "commit")) {
             self.wl.surface.commit();
@@ -502,12 +788,18 @@ pub const Surface = extern struct {
             return Error.RoleSetFailed;
         }
     }
+    pub fn setQueue(self: *Surface, queue: ?*WlEventQueue) Error!void {
+        if (!nwl_surface_set_queue(self, queue)) {
+            return Error.QueueSetFailed;
+        }
+    }
     pub const setSize = nwl_surface_set_size;
     pub const update = nwl_surface_update;
     pub const setTitle = nwl_surface_set_title;
     pub const setNeedUpdate = nwl_surface_set_need_update;
     pub const bufferSubmitted = nwl_surface_buffer_submitted;
     pub const requestCallback = nwl_surface_request_callback;
+    pub const handleDirt = nwl_surface_handle_dirt;
     pub const destroy = nwl_surface_destroy;
     pub const destroyLater = nwl_surface_destroy_later;
     pub const unsetRole = nwl_surface_role_unset;
@@ -537,13 +829,20 @@ pub const Easy = extern struct {
         const Data = extern struct {
             link: WlList = .{},
             fd: c_int,
+            events: u32,
+            priority: c_int = 0,
             userdata: ?*anyopaque,
             callback: CallbackFn,
+            uring_id: u64 = 0,
         };
         epfd: c_int = undefined,
         numfds: c_int = 0,
         ev: [*]std.os.linux.epoll_event = undefined,
         data: WlListHead(Data, .link) = .{},
+        backend: Backend = .epoll,
+        ring: ?*anyopaque = null,
+        uring_next_id: u64 = 0,
+        pub const Backend = enum(c_int) { epoll = 0, io_uring };
     };
     core: Core = .{},
     poll: Poll = .{},
@@ -552,6 +851,8 @@ pub const Easy = extern struct {
         global_destroy: ?*const fn (global: *const BoundGlobal) callconv(.c) void = null,
         global_add: ?*const fn (*Easy, *WlRegistry, u32, [*:0]const u8, u32) callconv(.c) bool = null,
         global_remove: ?*const fn (*Easy, *WlRegistry, u32) callconv(.c) void = null,
+        ready: ?*const fn (*Easy) callconv(.c) void = null,
+        congestion: ?*const fn (*Easy, bool) callconv(.c) void = null,
     } = .{},
     globals: WlListHead(Global, .link) = .{},
 
@@ -560,16 +861,25 @@ pub const Easy = extern struct {
     run_with_zero_surfaces: bool = false,
     has_errored: bool = false,
     has_new_outputs: bool = false,
+    async_startup: bool = false,
+    startup_cb: ?*WlCallback = null,
+    display_reading: bool = false,
+    display_has_pending: bool = false,
+    dispatch_budget: u32 = 0,
 
     extern fn nwl_easy_init(easy: *Easy) bool;
     extern fn nwl_easy_deinit(easy: *Easy) void;
     extern fn nwl_easy_run(easy: *Easy) void;
     extern fn nwl_easy_add_fd(easy: *Easy, fd: c_int, events: u32, callback: Poll.CallbackFn, data: ?*anyopaque) void;
     extern fn nwl_easy_del_fd(easy: *Easy, fd: c_int) void;
+    extern fn nwl_easy_mod_fd(easy: *Easy, fd: c_int, events: u32) void;
+    extern fn nwl_easy_set_fd_priority(easy: *Easy, fd: c_int, priority: c_int) void;
     extern fn nwl_easy_dispatch(easy: *Easy, timeout: c_int) bool;
 
     pub const addFd = nwl_easy_add_fd;
     pub const delFd = nwl_easy_del_fd;
+    pub const modFd = nwl_easy_mod_fd;
+    pub const setFdPriority = nwl_easy_set_fd_priority;
     pub const run = nwl_easy_run;
     pub fn dispatch(easy: *Easy, timeout: c_int) !void {
         if (!easy.nwl_easy_dispatch(timeout)) {
@@ -595,6 +905,7 @@ pub const Core = extern struct {
         subcompositor: ?*WlSubcompositor = null,
         data_device_manager: ?*WlDataDeviceManager = null,
         cursor_shape_manager: ?*WpCursorShapeManagerV1 = null,
+        tablet_manager: ?*ZwpTabletManagerV2 = null,
     } = .{},
     seats: WlListHead(Seat, .link) = .{},
     outputs: WlListHead(Output, .link) = .{},
@@ -602,24 +913,35 @@ pub const Core = extern struct {
     surfaces_dirty: WlListHead(Surface, .dirtlink) = .{},
     subs: WlListHead(StateSub, .link) = .{},
 
-    cursor_theme: ?*WlCursorTheme = null,
-    cursor_theme_size: u32 = 0,
     num_surfaces: u32 = 0,
     has_dirty_surfaces: bool = false,
+    display_congested: bool = false,
     xdg_app_id: ?[*:0]const u8 = null,
+    update_budget_us: u32 = 0,
+    updates_deferred: u32 = 0,
+    updates_deferred_total: u64 = 0,
+    update_threads: u32 = 0,
     extern fn nwl_core_init(core: *Core) void;
     extern fn nwl_core_deinit(core: *Core) void;
     extern fn nwl_core_handle_dirt(core: *Core) void;
     extern fn nwl_core_add_sub(core: *Core, sub: *StateSub) void;
     extern fn nwl_core_get_sub(core: *Core, impl: *StateSubImpl) ?*StateSub;
+    extern fn nwl_core_startup_trace(core: *Core, phase: [*:0]const u8) void;
     extern fn nwl_core_handle_global(core: *Core, registry: *WlRegistry, name: u32, interface: [*:0]const u8, version: u32) bool;
+    extern fn nwl_mime_atom(core: *Core, mime: [*:0]const u8) u32;
+    extern fn nwl_mime_atom_lookup(core: *Core, mime: [*:0]const u8) u32;
+    extern fn nwl_mime_atom_name(core: *Core, atom: u32) ?[*:0]const u8;
 
     pub const init = nwl_core_init;
     pub const deinit = nwl_core_deinit;
     pub const handleDirt = nwl_core_handle_dirt;
     pub const addSub = nwl_core_add_sub;
     pub const getSub = nwl_core_get_sub;
+    pub const startupTrace = nwl_core_startup_trace;
     pub const handleGlobal = nwl_core_handle_global;
+    pub const mimeAtom = nwl_mime_atom;
+    pub const mimeAtomLookup = nwl_mime_atom_lookup;
+    pub const mimeAtomName = nwl_mime_atom_name;
 };
 
 pub const ShmPool = extern struct {
@@ -634,6 +956,7 @@ pub const ShmPool = extern struct {
 
 pub const ShmBufferMan = extern struct {
     pub const max_buffers = 4;
+    pub const max_views = 8;
     pub const Buffer = extern struct {
         const Flags = packed struct(u8) {
             acquired: bool = false,
@@ -643,6 +966,8 @@ pub const ShmBufferMan = extern struct {
         wl_buffer: ?*WlBuffer = null,
         bufferdata: [*]u8 = undefined,
         flags: Flags = .{},
+        acquired: u8 = 0,
+        views: [max_views - 1]?*WlBuffer = @splat(null),
     };
     pub const RendererImpl = extern struct {
         buffer_create: *const fn (buf_idx: c_uint, bufferman: *ShmBufferMan) callconv(.c) void,
@@ -656,6 +981,7 @@ pub const ShmBufferMan = extern struct {
     stride: u32 = 0,
     format: u32 = 0,
     num_slots: u8 = 1,
+    queue: ?*WlEventQueue = null,
 
     extern fn nwl_shm_bufferman_get_next(bufferman: *ShmBufferMan) c_int;
     pub fn getNext(bufferman: *ShmBufferMan) !c_uint {
@@ -665,6 +991,8 @@ pub const ShmBufferMan = extern struct {
         }
         return error.NoAvailableBuffer;
     }
+    extern fn nwl_shm_bufferman_get_view(bufferman: *ShmBufferMan, buffer_idx: c_int, view: c_uint) ?*WlBuffer;
+    pub const getView = nwl_shm_bufferman_get_view;
     extern fn nwl_shm_bufferman_set_slots(bufferman: *ShmBufferMan, wl_shm: *WlShm, num_slots: u8) void;
     pub const setSlots = nwl_shm_bufferman_set_slots;
     extern fn nwl_shm_bufferman_resize(bufferman: *ShmBufferMan, wl_shm: *WlShm, width: u32, height: u32, stride: u32, format: u32) void;